@@ -0,0 +1,988 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include "actions.h"
+
+/* The files are only read a piece at a time. An action or the part of a
+ * file before the first action is never longer than this in practice. */
+#define MAX_FILE_SIZE (1024*1024)
+#define MAX_ELEMENT_SIZE (16*1024)
+
+#define MAX_ANNOTATIONS 16
+#define MAX_LOCALE_SIZE 64
+
+/* where an action is defined */
+struct action_ref {
+    uint64_t hash;
+    uint32_t file;
+    uint32_t offset;
+};
+
+struct action_file {
+    /* offset of the file name in names */
+    uint32_t name;
+    /* the file-wide vendor information comes before the first action */
+    uint32_t header_end;
+};
+
+struct action_index {
+    char *dir;
+    struct action_file *files;
+    uint32_t n_files;
+    char *names;
+    size_t names_size;
+    /* sorted by hash */
+    struct action_ref *refs;
+    uint32_t n_refs;
+    struct cache *cache;
+    /* The index that the tables above belong to, if they are shared. The
+     * owner keeps them until it and all the sharing indexes are freed. */
+    struct action_index *owner;
+    uint32_t n_sharing;
+    bool freed;
+};
+
+/* a piece of the XML text, not yet decoded */
+struct raw {
+    const char *p;
+    size_t len;
+};
+
+struct xml_tag {
+    const char *start;
+    const char *name;
+    size_t name_len;
+    const char *attrs;
+    size_t attrs_len;
+    bool closing;
+    bool empty;
+    /* right after the tag */
+    const char *end;
+};
+
+struct raw_details {
+    struct raw description;
+    struct raw message;
+    int description_score;
+    int message_score;
+    struct raw vendor;
+    struct raw vendor_url;
+    struct raw icon_name;
+    enum implicit_authorization implicit_any;
+    enum implicit_authorization implicit_inactive;
+    enum implicit_authorization implicit_active;
+    int n_annotations;
+    struct raw annotations[MAX_ANNOTATIONS][2];
+};
+
+static uint64_t hash_id(const char *id, size_t len)
+{
+    /* FNV-1a */
+    uint64_t h = 14695981039346656037ULL;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h ^= (unsigned char) id[i];
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool next_tag(const char *p, const char *end, struct xml_tag *t)
+{
+    const char *q;
+    char quote = 0;
+
+    for (;;) {
+        p = memchr(p, '<', end - p);
+        if (!p)
+            return false;
+
+        if (end - p >= 4 && memcmp(p, "<!--", 4) == 0) {
+            q = memmem(p + 4, end - p - 4, "-->", 3);
+            if (!q)
+                return false;
+            p = q + 3;
+            continue;
+        }
+
+        /* declarations and processing instructions */
+        if (end - p >= 2 && (p[1] == '!' || p[1] == '?')) {
+            q = memchr(p, '>', end - p);
+            if (!q)
+                return false;
+            p = q + 1;
+            continue;
+        }
+
+        break;
+    }
+
+    t->start = p++;
+
+    t->closing = p < end && *p == '/';
+    if (t->closing)
+        p++;
+
+    t->name = p;
+    while (p < end && !is_space(*p) && *p != '>' && *p != '/')
+        p++;
+    t->name_len = p - t->name;
+
+    t->attrs = p;
+    while (p < end) {
+        if (quote) {
+            if (*p == quote)
+                quote = 0;
+        }
+        else if (*p == '"' || *p == '\'')
+            quote = *p;
+        else if (*p == '>')
+            break;
+        p++;
+    }
+
+    if (p >= end)
+        return false;
+
+    t->empty = p > t->attrs && p[-1] == '/';
+    t->attrs_len = p - t->attrs - (t->empty ? 1 : 0);
+    t->end = p + 1;
+
+    return true;
+}
+
+static bool tag_is(const struct xml_tag *t, const char *name)
+{
+    return t->name_len == strlen(name) && memcmp(t->name, name, t->name_len) == 0;
+}
+
+static bool get_attr(const struct xml_tag *t, const char *name, struct raw *value)
+{
+    const char *p = t->attrs, *end = t->attrs + t->attrs_len;
+    const char *attr, *q;
+    size_t attr_len;
+    char quote;
+
+    while (p < end) {
+        while (p < end && is_space(*p))
+            p++;
+
+        attr = p;
+        while (p < end && *p != '=' && !is_space(*p))
+            p++;
+        attr_len = p - attr;
+
+        while (p < end && (is_space(*p) || *p == '='))
+            p++;
+
+        if (p >= end || (*p != '"' && *p != '\''))
+            return false;
+
+        quote = *p++;
+        q = memchr(p, quote, end - p);
+        if (!q)
+            return false;
+
+        if (attr_len == strlen(name) && memcmp(attr, name, attr_len) == 0) {
+            value->p = p;
+            value->len = q - p;
+            return true;
+        }
+
+        p = q + 1;
+    }
+
+    return false;
+}
+
+static struct raw element_text(const struct xml_tag *t, const char *end)
+{
+    struct raw text = { t->end, 0 };
+    const char *q;
+
+    if (t->empty)
+        return text;
+
+    q = memchr(t->end, '<', end - t->end);
+    text.len = (q ? q : end) - t->end;
+
+    /* drop the indentation around the text */
+    while (text.len > 0 && is_space(text.p[0])) {
+        text.p++;
+        text.len--;
+    }
+    while (text.len > 0 && is_space(text.p[text.len - 1]))
+        text.len--;
+
+    return text;
+}
+
+static bool raw_equals(struct raw r, const char *s)
+{
+    return r.len == strlen(s) && memcmp(r.p, s, r.len) == 0;
+}
+
+static enum implicit_authorization parse_implicit(struct raw r)
+{
+    if (raw_equals(r, "yes"))
+        return IMPLICIT_AUTHORIZED;
+    if (raw_equals(r, "auth_self"))
+        return IMPLICIT_AUTHENTICATION_REQUIRED;
+    if (raw_equals(r, "auth_admin"))
+        return IMPLICIT_ADMINISTRATOR_AUTHENTICATION_REQUIRED;
+    if (raw_equals(r, "auth_self_keep"))
+        return IMPLICIT_AUTHENTICATION_REQUIRED_RETAINED;
+    if (raw_equals(r, "auth_admin_keep"))
+        return IMPLICIT_ADMINISTRATOR_AUTHENTICATION_REQUIRED_RETAINED;
+
+    return IMPLICIT_NOT_AUTHORIZED;
+}
+
+static int lang_score(const struct xml_tag *t, const char *locale)
+{
+    struct raw lang;
+    size_t language_len;
+
+    /* Untranslated texts are the fallback. An exact match of the locale
+     * wins over a match of the language only, "de" for "de_AT". */
+
+    if (!get_attr(t, "xml:lang", &lang))
+        return 0;
+
+    if (lang.len == 0 || *locale == '\0')
+        return -1;
+
+    if (raw_equals(lang, locale))
+        return 2;
+
+    language_len = strcspn(locale, "_");
+    if (lang.len == language_len && memcmp(lang.p, locale, language_len) == 0)
+        return 1;
+
+    return -1;
+}
+
+static void parse_vendor_tag(const struct xml_tag *t, const char *end,
+        struct raw_details *rd)
+{
+    if (tag_is(t, "vendor"))
+        rd->vendor = element_text(t, end);
+    else if (tag_is(t, "vendor_url"))
+        rd->vendor_url = element_text(t, end);
+    else if (tag_is(t, "icon_name"))
+        rd->icon_name = element_text(t, end);
+}
+
+/* Parse the action that starts at p. Returns the id of the action. */
+static int parse_action(const char *p, const char *end, const char *locale,
+        struct raw *id, struct raw_details *rd)
+{
+    struct xml_tag t;
+    struct raw key;
+    int score;
+
+    if (!next_tag(p, end, &t) || t.closing || !tag_is(&t, "action") ||
+            !get_attr(&t, "id", id))
+        return -EINVAL;
+
+    rd->description_score = -1;
+    rd->message_score = -1;
+
+    /* the elements of polkit's policyconfig DTD, others are skipped */
+
+    for (p = t.end; next_tag(p, end, &t); p = t.end) {
+        if (t.closing) {
+            if (tag_is(&t, "action"))
+                break;
+            continue;
+        }
+
+        if (tag_is(&t, "description")) {
+            score = lang_score(&t, locale);
+            if (score > rd->description_score) {
+                rd->description = element_text(&t, end);
+                rd->description_score = score;
+            }
+        }
+        else if (tag_is(&t, "message")) {
+            score = lang_score(&t, locale);
+            if (score > rd->message_score) {
+                rd->message = element_text(&t, end);
+                rd->message_score = score;
+            }
+        }
+        else if (tag_is(&t, "allow_any"))
+            rd->implicit_any = parse_implicit(element_text(&t, end));
+        else if (tag_is(&t, "allow_inactive"))
+            rd->implicit_inactive = parse_implicit(element_text(&t, end));
+        else if (tag_is(&t, "allow_active"))
+            rd->implicit_active = parse_implicit(element_text(&t, end));
+        else if (tag_is(&t, "annotate")) {
+            if (rd->n_annotations < MAX_ANNOTATIONS && get_attr(&t, "key", &key)) {
+                rd->annotations[rd->n_annotations][0] = key;
+                rd->annotations[rd->n_annotations][1] = element_text(&t, end);
+                rd->n_annotations++;
+            }
+        }
+        else
+            parse_vendor_tag(&t, end, rd);
+    }
+
+    return 0;
+}
+
+static size_t encode_utf8(uint32_t c, char *out)
+{
+    if (c < 0x80) {
+        out[0] = c;
+        return 1;
+    }
+    if (c < 0x800) {
+        out[0] = 0xc0 | (c >> 6);
+        out[1] = 0x80 | (c & 0x3f);
+        return 2;
+    }
+    if (c < 0x10000) {
+        out[0] = 0xe0 | (c >> 12);
+        out[1] = 0x80 | ((c >> 6) & 0x3f);
+        out[2] = 0x80 | (c & 0x3f);
+        return 3;
+    }
+    out[0] = 0xf0 | (c >> 18);
+    out[1] = 0x80 | ((c >> 12) & 0x3f);
+    out[2] = 0x80 | ((c >> 6) & 0x3f);
+    out[3] = 0x80 | (c & 0x3f);
+    return 4;
+}
+
+static size_t decode_entity(const char *p, const char *end, char *out, size_t *used)
+{
+    static const struct { const char *name; char c; } entities[] = {
+        { "&lt;", '<' }, { "&gt;", '>' }, { "&amp;", '&' },
+        { "&quot;", '"' }, { "&apos;", '\'' },
+    };
+    const char *semicolon;
+    unsigned long c;
+    char *endp;
+    size_t i;
+
+    semicolon = memchr(p, ';', end - p);
+    if (!semicolon || semicolon - p > 10)
+        return 0;
+
+    for (i = 0; i < sizeof(entities) / sizeof(entities[0]); i++) {
+        if ((size_t) (semicolon + 1 - p) == strlen(entities[i].name) &&
+                memcmp(p, entities[i].name, semicolon + 1 - p) == 0) {
+            out[0] = entities[i].c;
+            *used = semicolon + 1 - p;
+            return 1;
+        }
+    }
+
+    if (p[1] != '#')
+        return 0;
+
+    if (p[2] == 'x')
+        c = strtoul(p + 3, &endp, 16);
+    else
+        c = strtoul(p + 2, &endp, 10);
+
+    /* only what makes valid UTF-8 */
+    if (endp != semicolon || c == 0 || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff))
+        return 0;
+
+    *used = semicolon + 1 - p;
+    return encode_utf8(c, out);
+}
+
+/* the length of the UTF-8 sequence that starts with a lead byte */
+static size_t utf8_sequence_len(char lead)
+{
+    unsigned char c = lead;
+
+    if ((c & 0xe0) == 0xc0)
+        return 2;
+    if ((c & 0xf0) == 0xe0)
+        return 3;
+    return 4;
+}
+
+static uint16_t append_raw(struct action_details *d, struct raw r)
+{
+    uint16_t offset = d->data_len;
+    const char *p = r.p, *end = r.p + r.len;
+    char buf[4];
+    size_t n, used, room;
+
+    /* Once the data is full, the strings that don't fit are empty and share
+     * the terminator of the last one that did. */
+    if (d->data_len >= ACTION_DETAILS_DATA_SIZE)
+        return ACTION_DETAILS_DATA_SIZE - 1;
+
+    room = ACTION_DETAILS_DATA_SIZE - 1 - d->data_len;
+
+    while (p < end) {
+        n = 0;
+        if (*p == '&')
+            n = decode_entity(p, end, buf, &used);
+        if (n == 0) {
+            buf[0] = *p;
+            n = used = 1;
+        }
+
+        if (n > room)
+            break;
+
+        memcpy(d->data + d->data_len, buf, n);
+        d->data_len += n;
+        room -= n;
+        p += used;
+    }
+
+    /* don't leave a partial UTF-8 sequence behind when cutting */
+    if (p < end) {
+        n = d->data_len;
+        while (n > offset && ((unsigned char) d->data[n - 1] & 0xc0) == 0x80)
+            n--;
+        if (n > offset && ((unsigned char) d->data[n - 1] & 0xc0) == 0xc0 &&
+                d->data_len - (n - 1) < utf8_sequence_len(d->data[n - 1]))
+            d->data_len = n - 1;
+    }
+
+    d->data[d->data_len++] = '\0';
+
+    return offset;
+}
+
+static void pack_details(const struct raw_details *rd, struct action_details *d)
+{
+    int i;
+
+    memset(d, 0, offsetof(struct action_details, data));
+
+    d->implicit_any = rd->implicit_any;
+    d->implicit_inactive = rd->implicit_inactive;
+    d->implicit_active = rd->implicit_active;
+
+    d->description = append_raw(d, rd->description);
+    d->message = append_raw(d, rd->message);
+    d->vendor = append_raw(d, rd->vendor);
+    d->vendor_url = append_raw(d, rd->vendor_url);
+    d->icon_name = append_raw(d, rd->icon_name);
+
+    d->annotations = d->data_len;
+    for (i = 0; i < rd->n_annotations; i++) {
+        /* a pair is added only if all of it fits */
+        if (d->data_len + rd->annotations[i][0].len + rd->annotations[i][1].len + 2 >
+                ACTION_DETAILS_DATA_SIZE)
+            break;
+
+        append_raw(d, rd->annotations[i][0]);
+        append_raw(d, rd->annotations[i][1]);
+        d->n_annotations++;
+    }
+}
+
+static char *read_file(const char *path, size_t *size)
+{
+    struct stat st;
+    char *data;
+    ssize_t len;
+    int fd;
+
+    fd = open(path, O_RDONLY|O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size > MAX_FILE_SIZE) {
+        close(fd);
+        return NULL;
+    }
+
+    data = malloc(st.st_size + 1);
+    if (!data) {
+        close(fd);
+        return NULL;
+    }
+
+    len = read(fd, data, st.st_size);
+    close(fd);
+
+    if (len < 0) {
+        free(data);
+        return NULL;
+    }
+
+    data[len] = '\0';
+    *size = len;
+
+    return data;
+}
+
+static ssize_t read_piece(struct action_index *ai, uint32_t file, uint32_t offset,
+        size_t size, char *buf)
+{
+    char path[1024];
+    ssize_t len;
+    int fd, r;
+
+    r = snprintf(path, sizeof(path), "%s/%s", ai->dir,
+            ai->names + ai->files[file].name);
+    if (r < 0 || (size_t) r >= sizeof(path))
+        return -ENAMETOOLONG;
+
+    fd = open(path, O_RDONLY|O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+
+    len = pread(fd, buf, size, offset);
+    if (len < 0)
+        len = -errno;
+
+    close(fd);
+    return len;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(const char **) a, *(const char **) b);
+}
+
+static int compare_refs(const void *a, const void *b)
+{
+    const struct action_ref *x = a, *y = b;
+
+    if (x->hash != y->hash)
+        return x->hash < y->hash ? -1 : 1;
+
+    /* the first definition wins, like in polkit */
+    if (x->file != y->file)
+        return x->file < y->file ? -1 : 1;
+
+    return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+static int add_ref(struct action_index *ai, uint32_t *max_refs, uint64_t hash,
+        uint32_t file, uint32_t offset)
+{
+    struct action_ref *refs;
+
+    if (ai->n_refs == *max_refs) {
+        *max_refs = *max_refs ? *max_refs * 2 : 64;
+        refs = realloc(ai->refs, *max_refs * sizeof(struct action_ref));
+        if (!refs)
+            return -ENOMEM;
+        ai->refs = refs;
+    }
+
+    ai->refs[ai->n_refs].hash = hash;
+    ai->refs[ai->n_refs].file = file;
+    ai->refs[ai->n_refs].offset = offset;
+    ai->n_refs++;
+
+    return 0;
+}
+
+static int index_file(struct action_index *ai, uint32_t file, uint32_t *max_refs)
+{
+    char path[1024];
+    struct xml_tag t;
+    struct raw id;
+    const char *p, *end;
+    char *data;
+    size_t size;
+    int r;
+
+    r = snprintf(path, sizeof(path), "%s/%s", ai->dir,
+            ai->names + ai->files[file].name);
+    if (r < 0 || (size_t) r >= sizeof(path))
+        return 0;
+
+    /* the whole file is read once here and dropped again */
+    data = read_file(path, &size);
+    if (!data) {
+        fprintf(stderr, "Error reading action file %s.\n", path);
+        return 0;
+    }
+
+    end = data + size;
+    ai->files[file].header_end = size;
+
+    for (p = data; next_tag(p, end, &t); p = t.end) {
+        if (t.closing || !tag_is(&t, "action") || !get_attr(&t, "id", &id))
+            continue;
+
+        if (ai->files[file].header_end == size)
+            ai->files[file].header_end = t.start - data;
+
+        r = add_ref(ai, max_refs, hash_id(id.p, id.len), file, t.start - data);
+        if (r < 0)
+            break;
+    }
+
+    free(data);
+    return r < 0 ? r : 0;
+}
+
+static int list_files(struct action_index *ai)
+{
+    const char **names = NULL, **tmp;
+    size_t n = 0, max = 0, len, offset = 0;
+    struct dirent *de;
+    uint32_t i;
+    DIR *d;
+    int r = 0;
+
+    d = opendir(ai->dir);
+    if (!d)
+        return 0;
+
+    while ((de = readdir(d))) {
+        len = strlen(de->d_name);
+        if (de->d_name[0] == '.' || len < 7 || strcmp(de->d_name + len - 7, ".policy") != 0)
+            continue;
+
+        if (n == max) {
+            max = max ? max * 2 : 32;
+            tmp = realloc(names, max * sizeof(char *));
+            if (!tmp) {
+                r = -ENOMEM;
+                goto end;
+            }
+            names = tmp;
+        }
+
+        names[n] = strdup(de->d_name);
+        if (!names[n]) {
+            r = -ENOMEM;
+            goto end;
+        }
+        n++;
+        ai->names_size += len + 1;
+    }
+
+    /* a stable order, so that the first definition of an action is always
+     * the same one */
+    qsort(names, n, sizeof(char *), compare_names);
+
+    ai->names = malloc(ai->names_size + 1);
+    ai->files = calloc(n + 1, sizeof(struct action_file));
+    if (!ai->names || !ai->files) {
+        r = -ENOMEM;
+        goto end;
+    }
+
+    for (i = 0; i < n; i++) {
+        ai->files[i].name = offset;
+        strcpy(ai->names + offset, names[i]);
+        offset += strlen(names[i]) + 1;
+    }
+    ai->n_files = n;
+
+end:
+    for (i = 0; i < n; i++)
+        free((char *) names[i]);
+    free(names);
+    closedir(d);
+
+    return r;
+}
+
+struct action_index *action_index_new(const char *dir, struct cache_budget *budget)
+{
+    struct action_index *ai;
+    struct action_ref *refs;
+    uint32_t i, max_refs = 0;
+
+    ai = calloc(1, sizeof(struct action_index));
+    if (!ai)
+        return NULL;
+
+    ai->dir = strdup(dir);
+    ai->cache = cache_new("action-details", budget);
+    if (!ai->dir || !ai->cache)
+        goto fail;
+
+    if (list_files(ai) < 0)
+        goto fail;
+
+    for (i = 0; i < ai->n_files; i++) {
+        if (index_file(ai, i, &max_refs) < 0)
+            goto fail;
+    }
+
+    qsort(ai->refs, ai->n_refs, sizeof(struct action_ref), compare_refs);
+
+    /* give back what the doubling left unused */
+    if (ai->n_refs > 0 && ai->n_refs < max_refs) {
+        refs = realloc(ai->refs, ai->n_refs * sizeof(struct action_ref));
+        if (refs)
+            ai->refs = refs;
+    }
+
+    return ai;
+
+fail:
+    action_index_free(ai);
+    return NULL;
+}
+
+struct action_index *action_index_share(struct action_index *from,
+        struct cache_budget *budget)
+{
+    struct action_index *owner = from->owner ? from->owner : from;
+    struct action_index *ai;
+
+    ai = calloc(1, sizeof(struct action_index));
+    if (!ai)
+        return NULL;
+
+    ai->cache = cache_new("action-details", budget);
+    if (!ai->cache) {
+        free(ai);
+        return NULL;
+    }
+
+    ai->dir = owner->dir;
+    ai->files = owner->files;
+    ai->n_files = owner->n_files;
+    ai->names = owner->names;
+    ai->names_size = owner->names_size;
+    ai->refs = owner->refs;
+    ai->n_refs = owner->n_refs;
+    ai->owner = owner;
+    owner->n_sharing++;
+
+    return ai;
+}
+
+static void free_tables(struct action_index *ai)
+{
+    free(ai->refs);
+    free(ai->files);
+    free(ai->names);
+    free(ai->dir);
+    free(ai);
+}
+
+void action_index_free(struct action_index *ai)
+{
+    struct action_index *owner;
+
+    if (!ai)
+        return;
+
+    cache_free(ai->cache);
+    ai->cache = NULL;
+
+    if (ai->owner) {
+        owner = ai->owner;
+        free(ai);
+
+        if (--owner->n_sharing == 0 && owner->freed)
+            free_tables(owner);
+        return;
+    }
+
+    if (ai->n_sharing > 0) {
+        ai->freed = true;
+        return;
+    }
+
+    free_tables(ai);
+}
+
+static size_t locale_base(const char *locale, char *buf, size_t size)
+{
+    size_t len;
+
+    /* "de_DE.UTF-8@euro" is "de_DE", and "C" and "POSIX" mean no locale */
+    len = strcspn(locale, ".@");
+    if (len >= size || (len == 1 && locale[0] == 'C') ||
+            (len == 5 && strncmp(locale, "POSIX", 5) == 0))
+        len = 0;
+
+    memcpy(buf, locale, len);
+    buf[len] = '\0';
+
+    return len;
+}
+
+static int parse_ref(struct action_index *ai, const struct action_ref *ref,
+        const char *action_id, const char *locale, struct action_details *d)
+{
+    struct raw_details rd;
+    struct raw id;
+    struct xml_tag t;
+    const char *p, *end;
+    char *buf;
+    ssize_t len;
+    uint32_t header_size;
+    int r;
+
+    buf = malloc(MAX_ELEMENT_SIZE);
+    if (!buf)
+        return -ENOMEM;
+
+    memset(&rd, 0, sizeof(rd));
+
+    len = read_piece(ai, ref->file, ref->offset, MAX_ELEMENT_SIZE, buf);
+    if (len < 0) {
+        r = len;
+        goto end;
+    }
+
+    r = parse_action(buf, buf + len, locale, &id, &rd);
+    if (r < 0)
+        goto end;
+
+    /* another action with the same hash */
+    if (!raw_equals(id, action_id)) {
+        r = -ENOENT;
+        goto end;
+    }
+
+    /* The vendor information of the action overrides the one of the file,
+     * which is read only if needed. */
+    if (!rd.vendor.p || !rd.vendor_url.p || !rd.icon_name.p) {
+        struct raw_details file_rd;
+        char *header;
+
+        memset(&file_rd, 0, sizeof(file_rd));
+
+        header_size = ai->files[ref->file].header_end;
+        if (header_size > MAX_ELEMENT_SIZE)
+            header_size = MAX_ELEMENT_SIZE;
+
+        header = malloc(header_size + 1);
+        if (!header) {
+            r = -ENOMEM;
+            goto end;
+        }
+
+        len = read_piece(ai, ref->file, 0, header_size, header);
+        if (len > 0) {
+            end = header + len;
+            for (p = header; next_tag(p, end, &t); p = t.end) {
+                if (!t.closing)
+                    parse_vendor_tag(&t, end, &file_rd);
+            }
+        }
+
+        if (!rd.vendor.p)
+            rd.vendor = file_rd.vendor;
+        if (!rd.vendor_url.p)
+            rd.vendor_url = file_rd.vendor_url;
+        if (!rd.icon_name.p)
+            rd.icon_name = file_rd.icon_name;
+
+        pack_details(&rd, d);
+        free(header);
+    }
+    else
+        pack_details(&rd, d);
+
+end:
+    free(buf);
+    return r;
+}
+
+int action_index_lookup(struct action_index *ai, const char *action_id,
+        const char *locale, struct action_details *details)
+{
+    char key[MAX_LOCALE_SIZE + 256];
+    char base[MAX_LOCALE_SIZE];
+    size_t id_len = strlen(action_id), key_len;
+    uint64_t hash = hash_id(action_id, id_len);
+    uint32_t lo = 0, hi = ai->n_refs, mid;
+    int r;
+
+    locale_base(locale, base, sizeof(base));
+
+    /* the texts depend on the locale, so it is a part of the key */
+    key_len = id_len + 1 + strlen(base);
+    if (key_len <= sizeof(key)) {
+        memcpy(key, action_id, id_len + 1);
+        memcpy(key + id_len + 1, base, strlen(base));
+
+        r = cache_lookup(ai->cache, key, key_len, details, sizeof(struct action_details));
+        if (r >= 0)
+            return 0;
+    }
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (ai->refs[mid].hash < hash)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (; lo < ai->n_refs && ai->refs[lo].hash == hash; lo++) {
+        r = parse_ref(ai, &ai->refs[lo], action_id, base, details);
+        if (r == -ENOENT)
+            continue;
+        if (r < 0)
+            return r;
+
+        if (key_len <= sizeof(key))
+            cache_insert(ai->cache, key, key_len, details,
+                    offsetof(struct action_details, data) + details->data_len, 0);
+
+        return 0;
+    }
+
+    return -ENOENT;
+}
+
+struct cache *action_index_cache(struct action_index *ai)
+{
+    return ai->cache;
+}
+
+size_t action_index_size(struct action_index *ai)
+{
+    return ai->n_refs;
+}
+
+size_t action_index_bytes(struct action_index *ai)
+{
+    /* the shared tables are counted for the owner */
+    if (ai->owner)
+        return sizeof(struct action_index);
+
+    return sizeof(struct action_index) + strlen(ai->dir) + 1
+            + ai->n_refs * sizeof(struct action_ref)
+            + (ai->n_files + 1) * sizeof(struct action_file)
+            + ai->names_size + 1;
+}
@@ -0,0 +1,88 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+
+#ifndef GROUPCHECK_ACTIONS_H
+#define GROUPCHECK_ACTIONS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "cache.h"
+
+/* Descriptions of polkit actions from the XML files of the installed
+ * services. Only an index of where each action is defined is kept in
+ * memory. The XML of an action is parsed when it is asked for, and the
+ * result is cached. */
+
+#define POLKIT_ACTIONS_DIR "/usr/share/polkit-1/actions"
+
+/* polkit's ImplicitAuthorization values */
+enum implicit_authorization {
+    IMPLICIT_NOT_AUTHORIZED = 0,
+    IMPLICIT_AUTHENTICATION_REQUIRED,
+    IMPLICIT_ADMINISTRATOR_AUTHENTICATION_REQUIRED,
+    IMPLICIT_AUTHENTICATION_REQUIRED_RETAINED,
+    IMPLICIT_ADMINISTRATOR_AUTHENTICATION_REQUIRED_RETAINED,
+    IMPLICIT_AUTHORIZED,
+};
+
+#define ACTION_DETAILS_DATA_SIZE 2048
+
+/* The strings are stored in data, at the given offsets. Longer texts are
+ * cut to fit. */
+
+struct action_details {
+    uint8_t implicit_any;
+    uint8_t implicit_inactive;
+    uint8_t implicit_active;
+    uint8_t n_annotations;
+    uint16_t description;
+    uint16_t message;
+    uint16_t vendor;
+    uint16_t vendor_url;
+    uint16_t icon_name;
+    /* n_annotations pairs of key and value, one after another */
+    uint16_t annotations;
+    uint16_t data_len;
+    char data[ACTION_DETAILS_DATA_SIZE];
+};
+
+struct action_index;
+
+/* Index the *.policy files of the directory. A missing directory gives an
+ * empty index. The parsed actions are cached in the budget. */
+struct action_index *action_index_new(const char *dir, struct cache_budget *budget);
+void action_index_free(struct action_index *ai);
+
+/* An index with the tables of another one, without reading the directory
+ * again, but with a cache of its own in the budget. The indexes can then be
+ * used from different threads. Sharing and freeing them is not thread-safe
+ * though: the index they share is kept until all of them are freed. */
+struct action_index *action_index_share(struct action_index *from,
+        struct cache_budget *budget);
+
+/* Find the action and parse it, picking the texts for the locale (like
+ * "de_DE.UTF-8") if they are translated. Returns -ENOENT if no file defines
+ * the action. */
+int action_index_lookup(struct action_index *ai, const char *action_id,
+        const char *locale, struct action_details *details);
+
+struct cache *action_index_cache(struct action_index *ai);
+
+/* number of indexed actions, and the bytes the index takes */
+size_t action_index_size(struct action_index *ai);
+size_t action_index_bytes(struct action_index *ai);
+
+#endif /* GROUPCHECK_ACTIONS_H */
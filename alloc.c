@@ -0,0 +1,79 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+
+/* The counters are updated from the loader thread too. */
+
+static uint64_t allocations;
+static uint64_t frees;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+void *__real_aligned_alloc(size_t alignment, size_t size);
+char *__real_strdup(const char *s);
+void __real_free(void *p);
+
+static void count_allocation(void)
+{
+    __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+}
+
+void *__wrap_malloc(size_t size)
+{
+    count_allocation();
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    count_allocation();
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+    count_allocation();
+    return __real_realloc(p, size);
+}
+
+void *__wrap_aligned_alloc(size_t alignment, size_t size)
+{
+    count_allocation();
+    return __real_aligned_alloc(alignment, size);
+}
+
+char *__wrap_strdup(const char *s)
+{
+    count_allocation();
+    return __real_strdup(s);
+}
+
+void __wrap_free(void *p)
+{
+    if (p)
+        __atomic_fetch_add(&frees, 1, __ATOMIC_RELAXED);
+    __real_free(p);
+}
+
+void alloc_get_stats(struct alloc_stats *stats)
+{
+    stats->allocations = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+    stats->frees = __atomic_load_n(&frees, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,33 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+
+#ifndef GROUPCHECK_ALLOC_H
+#define GROUPCHECK_ALLOC_H
+
+#include <stdint.h>
+
+/* Heap allocation counters for the groupcheck code. With
+ * --enable-alloc-accounting the objects are linked with --wrap options for
+ * the allocation functions, so only the calls made by groupcheck itself are
+ * counted, not the ones inside libc or libsystemd. */
+
+struct alloc_stats {
+    uint64_t allocations;
+    uint64_t frees;
+};
+
+void alloc_get_stats(struct alloc_stats *stats);
+
+#endif /* GROUPCHECK_ALLOC_H */
@@ -0,0 +1,577 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "cache.h"
+
+#define INITIAL_BUCKETS 16
+
+/* Weight is raised by one on every hit and capped, so that a burst of hits
+ * doesn't pin an entry for long after it has gone cold. */
+#define MAX_WEIGHT 7
+
+/* Entries up to the largest size class are carved from page-sized slabs
+ * and recycled through per-class free lists, so that a warmed cache
+ * replaces its entries without touching the heap. Bigger entries use
+ * malloc(). */
+#define SLAB_PAGE_SIZE 4096
+#define N_SIZE_CLASSES 5
+#define HEAP_CLASS N_SIZE_CLASSES
+
+/* at the start of every slab page, followed by the slots */
+struct slab_page {
+    struct slab_page *next;
+    uint32_t size_class;
+    /* number of slots handed out */
+    uint32_t used;
+};
+
+#define SLAB_HEADER_SIZE 16
+
+struct free_slot {
+    struct free_slot *next;
+};
+
+struct cache_entry {
+    struct cache_entry *hash_next;
+    struct cache_entry *clock_prev;
+    struct cache_entry *clock_next;
+    struct cache *cache;
+    uint32_t hash;
+    uint16_t weight;
+    uint16_t size_class;
+    uint64_t expires;
+    size_t key_len;
+    size_t value_len;
+    /* key is stored first, value right after it */
+    unsigned char data[];
+};
+
+/* The classes are sized for the key and value that follow the entry
+ * header, which takes 64 bytes itself. With the 16 byte page header, no
+ * class leaves more than 240 bytes of a page unused. */
+#define ENTRY_SLOT(payload) (sizeof(struct cache_entry) + (payload))
+
+static const size_t slot_sizes[N_SIZE_CLASSES] = {
+    ENTRY_SLOT(32), ENTRY_SLOT(64), ENTRY_SLOT(128), ENTRY_SLOT(256), ENTRY_SLOT(608)
+};
+
+struct cache_budget {
+    size_t max_bytes;
+    size_t bytes;
+    uint64_t evictions;
+
+    /* the clock hand, or NULL if the ring is empty */
+    struct cache_entry *hand;
+
+    struct slab_page *pages;
+    struct free_slot *free_slots[N_SIZE_CLASSES];
+    size_t slab_bytes;
+};
+
+struct cache {
+    const char *name;
+    struct cache_budget *budget;
+
+    struct cache_entry **buckets;
+    size_t n_buckets;
+
+    size_t n_entries;
+    size_t bytes;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+uint64_t cache_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000ULL + (uint64_t) ts.tv_nsec / 1000ULL;
+}
+
+static uint32_t hash_key(const void *key, size_t key_len)
+{
+    /* FNV-1a */
+    const unsigned char *p = key;
+    uint32_t h = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < key_len; i++) {
+        h ^= p[i];
+        h *= 16777619U;
+    }
+
+    return h;
+}
+
+static int size_class(size_t size)
+{
+    int i;
+
+    for (i = 0; i < N_SIZE_CLASSES; i++) {
+        if (size <= slot_sizes[i])
+            return i;
+    }
+
+    return HEAP_CLASS;
+}
+
+/* Entries are charged for the memory they really take. */
+static size_t charged_size(int class, size_t size)
+{
+    return class == HEAP_CLASS ? size : slot_sizes[class];
+}
+
+size_t cache_entry_size(size_t key_len, size_t value_len)
+{
+    size_t size = sizeof(struct cache_entry) + key_len + value_len;
+
+    return charged_size(size_class(size), size);
+}
+
+static size_t entry_size(struct cache_entry *entry)
+{
+    return charged_size(entry->size_class,
+            sizeof(struct cache_entry) + entry->key_len + entry->value_len);
+}
+
+static struct slab_page *slab_page_of(void *slot)
+{
+    return (struct slab_page *) ((uintptr_t) slot & ~(uintptr_t) (SLAB_PAGE_SIZE - 1));
+}
+
+static void *slab_alloc(struct cache_budget *b, int class)
+{
+    struct free_slot *slot;
+    struct slab_page *page;
+    size_t offset;
+
+    if (!b->free_slots[class]) {
+        page = aligned_alloc(SLAB_PAGE_SIZE, SLAB_PAGE_SIZE);
+        if (!page)
+            return NULL;
+
+        page->size_class = class;
+        page->used = 0;
+        page->next = b->pages;
+        b->pages = page;
+        b->slab_bytes += SLAB_PAGE_SIZE;
+
+        for (offset = SLAB_HEADER_SIZE; offset + slot_sizes[class] <= SLAB_PAGE_SIZE;
+                offset += slot_sizes[class]) {
+            slot = (struct free_slot *) ((char *) page + offset);
+            slot->next = b->free_slots[class];
+            b->free_slots[class] = slot;
+        }
+    }
+
+    slot = b->free_slots[class];
+    b->free_slots[class] = slot->next;
+    slab_page_of(slot)->used++;
+
+    return slot;
+}
+
+static void slab_free(struct cache_budget *b, void *p)
+{
+    struct slab_page *page = slab_page_of(p);
+    struct free_slot *slot = p;
+
+    page->used--;
+    slot->next = b->free_slots[page->size_class];
+    b->free_slots[page->size_class] = slot;
+}
+
+static size_t slab_release_empty(struct cache_budget *b)
+{
+    struct slab_page **page, *empty;
+    struct free_slot **slot;
+    size_t released = 0;
+    int i;
+
+    /* drop the free slots of empty pages, then the pages themselves */
+
+    for (i = 0; i < N_SIZE_CLASSES; i++) {
+        slot = &b->free_slots[i];
+        while (*slot) {
+            if (slab_page_of(*slot)->used == 0)
+                *slot = (*slot)->next;
+            else
+                slot = &(*slot)->next;
+        }
+    }
+
+    page = &b->pages;
+    while (*page) {
+        if ((*page)->used == 0) {
+            empty = *page;
+            *page = empty->next;
+            free(empty);
+            released += SLAB_PAGE_SIZE;
+        }
+        else
+            page = &(*page)->next;
+    }
+
+    b->slab_bytes -= released;
+
+    return released;
+}
+
+static void clock_unlink(struct cache_budget *b, struct cache_entry *entry)
+{
+    if (entry->clock_next == entry) {
+        b->hand = NULL;
+    }
+    else {
+        if (b->hand == entry)
+            b->hand = entry->clock_next;
+
+        entry->clock_prev->clock_next = entry->clock_next;
+        entry->clock_next->clock_prev = entry->clock_prev;
+    }
+
+    entry->clock_prev = entry->clock_next = NULL;
+}
+
+static void clock_link(struct cache_budget *b, struct cache_entry *entry)
+{
+    /* New entries go right behind the hand, so that they get a full sweep
+     * to collect hits before they are considered for eviction. */
+
+    if (!b->hand) {
+        entry->clock_prev = entry->clock_next = entry;
+        b->hand = entry;
+        return;
+    }
+
+    entry->clock_next = b->hand;
+    entry->clock_prev = b->hand->clock_prev;
+    b->hand->clock_prev->clock_next = entry;
+    b->hand->clock_prev = entry;
+}
+
+static struct cache_entry **find_slot(struct cache *c, const void *key,
+        size_t key_len, uint32_t hash)
+{
+    struct cache_entry **slot = &c->buckets[hash & (c->n_buckets - 1)];
+
+    while (*slot) {
+        struct cache_entry *entry = *slot;
+
+        if (entry->hash == hash && entry->key_len == key_len &&
+                memcmp(entry->data, key, key_len) == 0)
+            break;
+
+        slot = &entry->hash_next;
+    }
+
+    return slot;
+}
+
+static void remove_slot(struct cache *c, struct cache_entry **slot)
+{
+    struct cache_entry *entry = *slot;
+    size_t size = entry_size(entry);
+
+    *slot = entry->hash_next;
+    clock_unlink(c->budget, entry);
+
+    c->n_entries--;
+    c->bytes -= size;
+    c->budget->bytes -= size;
+
+    if (entry->size_class == HEAP_CLASS)
+        free(entry);
+    else
+        slab_free(c->budget, entry);
+}
+
+static void remove_entry(struct cache_entry *entry)
+{
+    struct cache *c = entry->cache;
+    struct cache_entry **slot;
+
+    slot = find_slot(c, entry->data, entry->key_len, entry->hash);
+    if (*slot)
+        remove_slot(c, slot);
+}
+
+static size_t evict_one(struct cache_budget *b, uint64_t now)
+{
+    struct cache_entry *entry;
+    size_t size;
+
+    /* Sweep until an entry with no weight left is found. Every step either
+     * lowers a weight or evicts, so this terminates within
+     * MAX_WEIGHT + 1 rounds. */
+
+    while ((entry = b->hand)) {
+        if (entry->weight > 0 && !(entry->expires && entry->expires <= now)) {
+            entry->weight--;
+            b->hand = entry->clock_next;
+            continue;
+        }
+
+        size = entry_size(entry);
+        entry->cache->evictions++;
+        b->evictions++;
+        remove_entry(entry);
+
+        return size;
+    }
+
+    return 0;
+}
+
+static void grow_buckets(struct cache *c)
+{
+    struct cache_entry **buckets;
+    size_t n_buckets = c->n_buckets * 2;
+    size_t i;
+
+    buckets = calloc(n_buckets, sizeof(struct cache_entry *));
+    if (!buckets) {
+        /* the cache keeps working with longer chains */
+        return;
+    }
+
+    for (i = 0; i < c->n_buckets; i++) {
+        struct cache_entry *entry = c->buckets[i];
+
+        while (entry) {
+            struct cache_entry *next = entry->hash_next;
+            size_t b = entry->hash & (n_buckets - 1);
+
+            entry->hash_next = buckets[b];
+            buckets[b] = entry;
+            entry = next;
+        }
+    }
+
+    free(c->buckets);
+    c->buckets = buckets;
+    c->n_buckets = n_buckets;
+}
+
+struct cache_budget *cache_budget_new(size_t max_bytes)
+{
+    struct cache_budget *b;
+
+    b = calloc(1, sizeof(struct cache_budget));
+    if (!b)
+        return NULL;
+
+    b->max_bytes = max_bytes;
+
+    return b;
+}
+
+void cache_budget_free(struct cache_budget *b)
+{
+    struct slab_page *page;
+
+    if (!b)
+        return;
+
+    while ((page = b->pages)) {
+        b->pages = page->next;
+        free(page);
+    }
+
+    free(b);
+}
+
+size_t cache_budget_shrink(struct cache_budget *b, size_t target_bytes)
+{
+    size_t before = b->bytes;
+    uint64_t now = cache_now();
+
+    while (b->bytes > target_bytes && evict_one(b, now) > 0)
+        ;
+
+    /* give the pages that were emptied back to the heap */
+    slab_release_empty(b);
+
+    return before - b->bytes;
+}
+
+void cache_budget_get_stats(struct cache_budget *b, struct cache_budget_stats *stats)
+{
+    stats->max_bytes = b->max_bytes;
+    stats->bytes = b->bytes;
+    stats->evictions = b->evictions;
+    stats->slab_bytes = b->slab_bytes;
+}
+
+struct cache *cache_new(const char *name, struct cache_budget *budget)
+{
+    struct cache *c;
+
+    c = calloc(1, sizeof(struct cache));
+    if (!c)
+        return NULL;
+
+    c->buckets = calloc(INITIAL_BUCKETS, sizeof(struct cache_entry *));
+    if (!c->buckets) {
+        free(c);
+        return NULL;
+    }
+
+    c->n_buckets = INITIAL_BUCKETS;
+    c->name = name;
+    c->budget = budget;
+
+    return c;
+}
+
+void cache_free(struct cache *c)
+{
+    if (!c)
+        return;
+
+    cache_clear(c);
+    free(c->buckets);
+    free(c);
+}
+
+const char *cache_name(struct cache *c)
+{
+    return c->name;
+}
+
+int cache_lookup(struct cache *c, const void *key, size_t key_len,
+        void *value, size_t value_size)
+{
+    struct cache_entry **slot;
+    struct cache_entry *entry;
+
+    slot = find_slot(c, key, key_len, hash_key(key, key_len));
+    entry = *slot;
+
+    if (entry && entry->expires && entry->expires <= cache_now()) {
+        remove_slot(c, slot);
+        entry = NULL;
+    }
+
+    if (!entry) {
+        c->misses++;
+        return -ENOENT;
+    }
+
+    if (entry->value_len > value_size)
+        return -ENOBUFS;
+
+    memcpy(value, entry->data + entry->key_len, entry->value_len);
+
+    if (entry->weight < MAX_WEIGHT)
+        entry->weight++;
+    c->hits++;
+
+    return entry->value_len;
+}
+
+int cache_insert(struct cache *c, const void *key, size_t key_len,
+        const void *value, size_t value_len, uint64_t expires)
+{
+    struct cache_budget *b = c->budget;
+    struct cache_entry **slot;
+    struct cache_entry *entry;
+    uint32_t hash = hash_key(key, key_len);
+    int class = size_class(sizeof(struct cache_entry) + key_len + value_len);
+    size_t size = charged_size(class, sizeof(struct cache_entry) + key_len + value_len);
+    uint64_t now;
+
+    if (size > b->max_bytes)
+        return -E2BIG;
+
+    slot = find_slot(c, key, key_len, hash);
+    if (*slot)
+        remove_slot(c, slot);
+
+    /* make room for the new entry */
+    if (b->bytes + size > b->max_bytes) {
+        now = cache_now();
+        while (b->bytes + size > b->max_bytes && evict_one(b, now) > 0)
+            ;
+    }
+
+    if (class == HEAP_CLASS)
+        entry = malloc(size);
+    else
+        entry = slab_alloc(b, class);
+    if (!entry)
+        return -ENOMEM;
+
+    entry->cache = c;
+    entry->hash = hash;
+    entry->weight = 0;
+    entry->size_class = class;
+    entry->expires = expires;
+    entry->key_len = key_len;
+    entry->value_len = value_len;
+    memcpy(entry->data, key, key_len);
+    memcpy(entry->data + key_len, value, value_len);
+
+    if (c->n_entries >= c->n_buckets)
+        grow_buckets(c);
+
+    slot = &c->buckets[hash & (c->n_buckets - 1)];
+    entry->hash_next = *slot;
+    *slot = entry;
+    clock_link(b, entry);
+
+    c->n_entries++;
+    c->bytes += size;
+    b->bytes += size;
+
+    return 0;
+}
+
+void cache_remove(struct cache *c, const void *key, size_t key_len)
+{
+    struct cache_entry **slot;
+
+    slot = find_slot(c, key, key_len, hash_key(key, key_len));
+    if (*slot)
+        remove_slot(c, slot);
+}
+
+void cache_clear(struct cache *c)
+{
+    size_t i;
+
+    for (i = 0; i < c->n_buckets; i++) {
+        while (c->buckets[i])
+            remove_slot(c, &c->buckets[i]);
+    }
+}
+
+void cache_get_stats(struct cache *c, struct cache_stats *stats)
+{
+    stats->entries = c->n_entries;
+    stats->bytes = c->bytes;
+    stats->index_bytes = c->n_buckets * sizeof(struct cache_entry *);
+    stats->hits = c->hits;
+    stats->misses = c->misses;
+    stats->evictions = c->evictions;
+}
@@ -0,0 +1,87 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+#ifndef GROUPCHECK_CACHE_H
+#define GROUPCHECK_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Small hash tables mapping binary keys to binary values. Values are copied
+ * in and out, so the caller never holds pointers to cache memory.
+ *
+ * All caches draw from one shared byte budget. Entries of all caches form a
+ * single CLOCK ring: every hit raises the weight of an entry, and the clock
+ * hand lowers the weights as it sweeps. An entry is evicted when the hand
+ * finds it with zero weight, so frequently hit entries survive longer no
+ * matter which cache they belong to. */
+
+struct cache;
+struct cache_budget;
+
+struct cache_stats {
+    size_t entries;
+    size_t bytes;
+    /* the hash table, not charged to the budget */
+    size_t index_bytes;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+struct cache_budget_stats {
+    size_t max_bytes;
+    size_t bytes;
+    uint64_t evictions;
+    /* memory held by the entry slabs, used or not */
+    size_t slab_bytes;
+};
+
+struct cache_budget *cache_budget_new(size_t max_bytes);
+void cache_budget_free(struct cache_budget *b);
+
+/* Evict entries from all caches until at most target_bytes are in use, and
+ * free the slab pages that became empty. Returns the number of bytes
+ * released. */
+size_t cache_budget_shrink(struct cache_budget *b, size_t target_bytes);
+
+void cache_budget_get_stats(struct cache_budget *b, struct cache_budget_stats *stats);
+
+/* The budget must outlive the caches that use it. */
+struct cache *cache_new(const char *name, struct cache_budget *budget);
+void cache_free(struct cache *c);
+
+const char *cache_name(struct cache *c);
+
+/* Copy the value for the key to the buffer. Returns the value length, or
+ * -ENOENT if there is no valid entry, or -ENOBUFS if the buffer is too small. */
+int cache_lookup(struct cache *c, const void *key, size_t key_len,
+        void *value, size_t value_size);
+
+/* Add or replace an entry. If expires is not zero, the entry is valid until
+ * that CLOCK_MONOTONIC time in microseconds. */
+int cache_insert(struct cache *c, const void *key, size_t key_len,
+        const void *value, size_t value_len, uint64_t expires);
+
+void cache_remove(struct cache *c, const void *key, size_t key_len);
+void cache_clear(struct cache *c);
+
+void cache_get_stats(struct cache *c, struct cache_stats *stats);
+
+/* the number of bytes that an entry is charged for */
+size_t cache_entry_size(size_t key_len, size_t value_len);
+
+uint64_t cache_now(void);
+
+#endif /* GROUPCHECK_CACHE_H */
@@ -0,0 +1,797 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stddef.h>
+
+#include "engine.h"
+
+/* Whether the subject can change the decision for an action. Derived from
+ * the resolved groups, so it is reset together with them. */
+
+enum action_class {
+    ACTION_UNCLASSIFIED = 0,
+    /* none of the groups exist and the rule needs some, nobody is allowed */
+    ACTION_DENY_ALL,
+    ACTION_CHECK_SUBJECT,
+};
+
+/* the actions allowed by membership in a gid */
+
+struct gid_actions {
+    gid_t gid;
+    /* policy_action_words() words of action bits */
+    uint32_t *actions;
+};
+
+/* Subject credentials in the form that is stored in the credential caches.
+ * Only credentials that passed the uid checks are cached. */
+
+#define MAX_CACHED_GIDS 64
+
+struct cached_creds {
+    uid_t uid;
+    gid_t primary_gid;
+    uint32_t n_gids;
+    gid_t gids[MAX_CACHED_GIDS];
+};
+
+struct subject_creds {
+    uid_t uid;
+    gid_t primary_gid;
+    int n_gids;
+    /* points either to the cache copy or to the engine scratch array */
+    const gid_t *gids;
+    struct cached_creds cached;
+};
+
+static const char *cache_names[N_CACHES] = {
+    [CACHE_BUS_CREDS] = "bus-creds",
+    [CACHE_PROCESS_CREDS] = "process-creds",
+    [CACHE_SESSION_UIDS] = "session-uids",
+    [CACHE_USER_GROUPS] = "user-groups",
+};
+
+enum creds_source {
+    SOURCE_PROCESS,
+    SOURCE_BUS_NAME,
+    SOURCE_USER,
+};
+
+static int grow_gids(struct engine *e, int n_gids)
+{
+    gid_t *gids;
+
+    gids = realloc(e->gids, n_gids * sizeof(gid_t));
+    if (!gids)
+        return -ENOMEM;
+
+    e->gids = gids;
+    e->max_gids = n_gids;
+
+    return 0;
+}
+
+static int query_creds(struct engine *e, enum creds_source source,
+        const struct subject *subject, uid_t uid, struct subject_creds *sc)
+{
+    struct engine_creds creds;
+    int r;
+
+    /* The scratch array grows to the largest group list seen, so that only
+     * the first subject with that many groups causes an allocation. */
+
+    for (;;) {
+        creds.uid = uid;
+        creds.primary_gid = 0;
+        creds.n_gids = 0;
+        creds.max_gids = e->max_gids;
+        creds.gids = e->gids;
+
+        switch (source) {
+        case SOURCE_PROCESS:
+            r = e->provider->process_creds(e->userdata, subject->data.p.pid,
+                    subject->data.p.start_time, &creds);
+            break;
+        case SOURCE_BUS_NAME:
+            r = e->provider->bus_name_creds(e->userdata,
+                    subject->data.b.system_bus_name, &creds);
+            break;
+        default:
+            r = e->provider->user_groups(e->userdata, uid, &creds);
+            break;
+        }
+
+        if (r < 0)
+            return r;
+
+        if (creds.n_gids < 0)
+            return -EINVAL;
+
+        if (creds.n_gids <= creds.max_gids)
+            break;
+
+        r = grow_gids(e, creds.n_gids);
+        if (r < 0)
+            return r;
+    }
+
+    sc->uid = creds.uid;
+    sc->primary_gid = creds.primary_gid;
+    sc->n_gids = creds.n_gids;
+    sc->gids = e->gids;
+
+    return 0;
+}
+
+static int lookup_cached_creds(struct cache *cache, const void *key, size_t key_len,
+        struct subject_creds *sc)
+{
+    int r;
+
+    r = cache_lookup(cache, key, key_len, &sc->cached, sizeof(sc->cached));
+    if (r < 0)
+        return r;
+
+    sc->uid = sc->cached.uid;
+    sc->primary_gid = sc->cached.primary_gid;
+    sc->n_gids = sc->cached.n_gids;
+    sc->gids = sc->cached.gids;
+
+    return 0;
+}
+
+static void store_cached_creds(struct cache *cache, const void *key, size_t key_len,
+        struct subject_creds *sc, uint64_t expires)
+{
+    struct cached_creds *cc = &sc->cached;
+
+    if (sc->n_gids > MAX_CACHED_GIDS)
+        return;
+
+    cc->uid = sc->uid;
+    cc->primary_gid = sc->primary_gid;
+    cc->n_gids = sc->n_gids;
+    memcpy(cc->gids, sc->gids, sc->n_gids * sizeof(gid_t));
+
+    /* failing to cache is not an error */
+    cache_insert(cache, key, key_len, cc,
+            offsetof(struct cached_creds, gids) + sc->n_gids * sizeof(gid_t),
+            expires);
+}
+
+static int get_process_creds(struct engine *e, const struct subject *subject,
+        struct subject_creds *sc)
+{
+    uint64_t key[2] = { subject->data.p.pid, subject->data.p.start_time };
+    struct subject resolved;
+    int r;
+
+    /* Like polkit, take a zero start time to mean the one the process has
+     * now. It is looked up before the cache, as the key needs it. */
+    if (key[1] == 0) {
+        r = e->provider->process_start_time(e->userdata, subject->data.p.pid,
+                &key[1]);
+        if (r < 0)
+            return r;
+
+        resolved = *subject;
+        resolved.data.p.start_time = key[1];
+        subject = &resolved;
+    }
+
+    /* The start time is part of the key, so a cached entry can't belong to
+     * another process that reused the pid. */
+    r = lookup_cached_creds(e->caches[CACHE_PROCESS_CREDS], key, sizeof(key), sc);
+    if (r == 0)
+        return 0;
+
+    r = query_creds(e, SOURCE_PROCESS, subject, (uid_t) -1, sc);
+    if (r < 0)
+        return r;
+
+    store_cached_creds(e->caches[CACHE_PROCESS_CREDS], key, sizeof(key), sc,
+            cache_now() + PROCESS_CREDS_TTL_USEC);
+
+    return 0;
+}
+
+static int get_bus_name_creds(struct engine *e, const struct subject *subject,
+        struct subject_creds *sc)
+{
+    const char *name = subject->data.b.system_bus_name;
+    bool unique = name[0] == ':';
+    int r;
+
+    /* Well-known names may change owners, so only unique names are cached. */
+    if (unique) {
+        r = lookup_cached_creds(e->caches[CACHE_BUS_CREDS], name, strlen(name), sc);
+        if (r == 0)
+            return 0;
+    }
+
+    r = query_creds(e, SOURCE_BUS_NAME, subject, (uid_t) -1, sc);
+    if (r < 0)
+        return r;
+
+    if (unique)
+        store_cached_creds(e->caches[CACHE_BUS_CREDS], name, strlen(name), sc, 0);
+
+    return 0;
+}
+
+static int get_session_creds(struct engine *e, const struct subject *subject,
+        struct subject_creds *sc)
+{
+    const char *session = subject->data.s.session_id;
+    uid_t uid;
+    int r;
+
+    /* A session belongs to one user for its whole lifetime, and the cache
+     * is flushed when logind reports session changes. */
+    r = cache_lookup(e->caches[CACHE_SESSION_UIDS], session, strlen(session),
+            &uid, sizeof(uid));
+    if (r < 0) {
+        r = e->provider->session_uid(e->userdata, session, &uid);
+        if (r < 0)
+            return r;
+
+        cache_insert(e->caches[CACHE_SESSION_UIDS], session, strlen(session),
+                &uid, sizeof(uid), 0);
+    }
+
+    r = lookup_cached_creds(e->caches[CACHE_USER_GROUPS], &uid, sizeof(uid), sc);
+    if (r == 0)
+        return 0;
+
+    r = query_creds(e, SOURCE_USER, subject, uid, sc);
+    if (r < 0)
+        return r;
+
+    /* kept until the group database changes */
+    store_cached_creds(e->caches[CACHE_USER_GROUPS], &uid, sizeof(uid), sc, 0);
+
+    return 0;
+}
+
+static int get_subject_creds(struct engine *e, const struct subject *subject,
+        struct subject_creds *sc)
+{
+    switch (subject->kind) {
+    case SUBJECT_KIND_UNIX_PROCESS:
+        return get_process_creds(e, subject, sc);
+
+    case SUBJECT_KIND_SYSTEM_BUS_NAME:
+        return get_bus_name_creds(e, subject, sc);
+
+    case SUBJECT_KIND_UNIX_SESSION:
+        return get_session_creds(e, subject, sc);
+
+    default:
+        /* not supported yet */
+        return -EOPNOTSUPP;
+    }
+}
+
+static int resolve_group(struct engine *e, uint32_t group, gid_t *gid)
+{
+    struct resolved_group *rg = &e->groups[group];
+    gid_t found;
+
+    if (rg->state == GROUP_UNRESOLVED) {
+        /* Unknown groups are remembered too, to avoid repeated NSS queries.
+         * The states are reset when the group database changes. */
+        if (e->provider->group_gid(e->userdata,
+                policy_group_name(e->policy, group), &found) == 0) {
+            rg->state = GROUP_FOUND;
+            rg->gid = found;
+        }
+        else {
+            rg->state = GROUP_MISSING;
+            rg->gid = 0;
+        }
+    }
+
+    if (rg->state != GROUP_FOUND)
+        return -ENOENT;
+
+    *gid = rg->gid;
+    return 0;
+}
+
+static enum action_class classify_action(struct engine *e, uint32_t action)
+{
+    const uint32_t *groups;
+    uint32_t n_groups, i;
+    gid_t gid;
+
+    if (e->action_classes[action] != ACTION_UNCLASSIFIED)
+        return e->action_classes[action];
+
+    /* A group that exists but has no members in the group database can't
+     * be treated like a missing one: supplementary groups can also be set
+     * by the service manager or come from other NSS sources. */
+
+    e->action_classes[action] = ACTION_CHECK_SUBJECT;
+
+    groups = policy_action_groups(e->policy, action, &n_groups);
+    for (i = 0; i < n_groups; i++) {
+        if (resolve_group(e, groups[i], &gid) == 0)
+            return ACTION_CHECK_SUBJECT;
+    }
+
+    /* Nobody is in any of the groups. A rule like "!guests" still allows
+     * everyone then, but the subject has to pass the credential checks. */
+    if (!policy_action_allows(e->policy, action, 0))
+        e->action_classes[action] = ACTION_DENY_ALL;
+
+    return e->action_classes[action];
+}
+
+static void free_gid_index(struct engine *e)
+{
+    uint32_t i;
+
+    for (i = 0; i < e->n_gid_index; i++)
+        free(e->gid_index[i].actions);
+
+    free(e->gid_index);
+    e->gid_index = NULL;
+    e->n_gid_index = 0;
+}
+
+static int compare_gid_actions(const void *a, const void *b)
+{
+    const struct gid_actions *x = a, *y = b;
+
+    return x->gid < y->gid ? -1 : x->gid > y->gid;
+}
+
+static int build_gid_index(struct engine *e)
+{
+    uint32_t n_groups = policy_n_groups(e->policy);
+    uint32_t words = policy_action_words(e->policy);
+    struct gid_actions *index;
+    uint32_t g, i, w, n = 0;
+    gid_t gid;
+
+    index = calloc(n_groups + 1, sizeof(struct gid_actions));
+    if (!index)
+        return -ENOMEM;
+
+    /* one entry for every gid that a policy group resolves to */
+    for (g = 0; g < n_groups; g++) {
+        const uint32_t *bits = policy_group_actions(e->policy, g);
+
+        if (resolve_group(e, g, &gid) < 0)
+            continue;
+
+        for (i = 0; i < n; i++) {
+            if (index[i].gid == gid)
+                break;
+        }
+
+        if (i == n) {
+            index[n].gid = gid;
+            index[n].actions = calloc(words + 1, sizeof(uint32_t));
+            if (!index[n].actions)
+                goto fail;
+            n++;
+        }
+
+        /* several group names may have the same gid */
+        for (w = 0; w < words; w++)
+            index[i].actions[w] |= bits[w];
+    }
+
+    qsort(index, n, sizeof(struct gid_actions), compare_gid_actions);
+
+    free_gid_index(e);
+    e->gid_index = index;
+    e->n_gid_index = n;
+
+    return 0;
+
+fail:
+    for (i = 0; i < n; i++)
+        free(index[i].actions);
+    free(index);
+    return -ENOMEM;
+}
+
+static const struct gid_actions *find_gid_actions(struct engine *e, gid_t gid)
+{
+    struct gid_actions key = { .gid = gid };
+
+    return bsearch(&key, e->gid_index, e->n_gid_index,
+            sizeof(struct gid_actions), compare_gid_actions);
+}
+
+static uint64_t member_mask(struct engine *e, const uint32_t *groups,
+        uint32_t n_groups, struct subject_creds *sc)
+{
+    uint64_t mask = 0;
+    uint32_t i;
+    int j;
+
+    /* bit i is set if the subject is in the i:th group of the rule */
+
+    for (i = 0; i < n_groups; i++) {
+        gid_t gid;
+
+        if (resolve_group(e, groups[i], &gid) < 0)
+            continue;
+
+        for (j = 0; j < sc->n_gids; j++) {
+
+            if (sc->gids[j] == sc->primary_gid) {
+                /* We only include supplementary gids in the check, not the
+                   primary gid. This is to make it more difficult for
+                   processes to exec a setgid process to gain elevated
+                   group access. */
+                   continue;
+            }
+
+            if (sc->gids[j] == gid) {
+                mask |= 1ULL << i;
+                break;
+            }
+        }
+    }
+
+    return mask;
+}
+
+int engine_init(struct engine *e, const struct engine_provider *provider,
+        void *userdata, struct cache_budget *budget)
+{
+    int i;
+
+    memset(e, 0, sizeof(struct engine));
+
+    e->provider = provider;
+    e->userdata = userdata;
+    e->subject_uid = (uid_t) -1;
+
+    for (i = 0; i < N_CACHES; i++) {
+        e->caches[i] = cache_new(cache_names[i], budget);
+        if (!e->caches[i])
+            return -ENOMEM;
+    }
+
+    return grow_gids(e, MAX_CACHED_GIDS);
+}
+
+void engine_done(struct engine *e)
+{
+    int i;
+
+    for (i = 0; i < N_CACHES; i++)
+        cache_free(e->caches[i]);
+
+    free_gid_index(e);
+    if (!e->policy_shared)
+        policy_free(e->policy);
+    free(e->groups);
+    free(e->action_requests);
+    free(e->action_classes);
+    free(e->action_bits);
+    free(e->gids);
+
+    memset(e, 0, sizeof(struct engine));
+}
+
+int engine_set_policy(struct engine *e, struct policy *policy,
+        struct resolved_group *groups, uint64_t *action_requests)
+{
+    uint32_t n_actions = policy_n_actions(policy);
+
+    e->policy = policy;
+    e->policy_shared = false;
+    e->groups = groups;
+    e->action_requests = action_requests;
+
+    if (!e->groups)
+        e->groups = calloc(policy_n_groups(policy) + 1, sizeof(struct resolved_group));
+
+    if (!e->action_requests)
+        e->action_requests = calloc(n_actions + 1, sizeof(uint64_t));
+
+    e->action_classes = calloc(n_actions + 1, sizeof(uint8_t));
+    e->action_bits = calloc(policy_action_words(policy) + 1, sizeof(uint32_t));
+
+    if (!e->groups || !e->action_requests || !e->action_classes || !e->action_bits)
+        return -ENOMEM;
+
+    return 0;
+}
+
+int engine_replace_policy(struct engine *e, struct policy *policy)
+{
+    struct engine n = *e;
+    uint32_t n_actions = policy_n_actions(policy);
+    uint32_t a;
+    int old, r;
+
+    n.gid_index = NULL;
+    n.n_gid_index = 0;
+
+    r = engine_set_policy(&n, policy, NULL, NULL);
+    if (r < 0) {
+        free(n.groups);
+        free(n.action_requests);
+        free(n.action_classes);
+        free(n.action_bits);
+        return r;
+    }
+
+    /* keep the counters of the actions that are still there */
+    for (a = 0; a < n_actions; a++) {
+        old = policy_find_action(e->policy, policy_action_id(policy, a));
+        if (old >= 0)
+            n.action_requests[a] = e->action_requests[old];
+    }
+
+    free_gid_index(e);
+    if (!e->policy_shared)
+        policy_free(e->policy);
+    free(e->groups);
+    free(e->action_requests);
+    free(e->action_classes);
+    free(e->action_bits);
+
+    *e = n;
+
+    return 0;
+}
+
+int engine_share_policy(struct engine *e, const struct engine *from)
+{
+    struct policy *policy = from->policy;
+    uint32_t n_actions = policy_n_actions(policy);
+    uint32_t n_groups = policy_n_groups(policy);
+    struct resolved_group *groups;
+    uint64_t *action_requests;
+    uint8_t *action_classes;
+    uint32_t *action_bits;
+
+    groups = calloc(n_groups + 1, sizeof(struct resolved_group));
+    action_requests = calloc(n_actions + 1, sizeof(uint64_t));
+    action_classes = calloc(n_actions + 1, sizeof(uint8_t));
+    action_bits = calloc(policy_action_words(policy) + 1, sizeof(uint32_t));
+
+    if (!groups || !action_requests || !action_classes || !action_bits) {
+        free(groups);
+        free(action_requests);
+        free(action_classes);
+        free(action_bits);
+        return -ENOMEM;
+    }
+
+    /* what the other engine knows about the groups saves NSS queries */
+    memcpy(groups, from->groups, n_groups * sizeof(struct resolved_group));
+    memcpy(action_classes, from->action_classes, n_actions);
+
+    free_gid_index(e);
+    if (!e->policy_shared)
+        policy_free(e->policy);
+    free(e->groups);
+    free(e->action_requests);
+    free(e->action_classes);
+    free(e->action_bits);
+
+    e->policy = policy;
+    e->policy_shared = true;
+    e->groups = groups;
+    e->action_requests = action_requests;
+    e->action_classes = action_classes;
+    e->action_bits = action_bits;
+
+    return 0;
+}
+
+void engine_merge_counters(struct engine *e, struct engine *from)
+{
+    uint32_t a;
+
+    if (from->policy == e->policy) {
+        for (a = 0; a < policy_n_actions(e->policy); a++) {
+            e->action_requests[a] += from->action_requests[a];
+            from->action_requests[a] = 0;
+        }
+    }
+
+    e->stats.short_circuited += from->stats.short_circuited;
+    from->stats.short_circuited = 0;
+}
+
+void engine_prepare(struct engine *e)
+{
+    uint32_t n_actions = policy_n_actions(e->policy);
+    uint32_t a;
+
+    for (a = 0; a < n_actions; a++)
+        classify_action(e, a);
+
+    build_gid_index(e);
+}
+
+void engine_groups_changed(struct engine *e)
+{
+    /* group names may now resolve to different gids */
+    memset(e->groups, 0, policy_n_groups(e->policy) * sizeof(struct resolved_group));
+    memset(e->action_classes, 0, policy_n_actions(e->policy));
+    free_gid_index(e);
+
+    cache_clear(e->caches[CACHE_USER_GROUPS]);
+}
+
+void engine_sessions_changed(struct engine *e)
+{
+    cache_clear(e->caches[CACHE_SESSION_UIDS]);
+}
+
+void engine_bus_name_gone(struct engine *e, const char *name)
+{
+    cache_remove(e->caches[CACHE_BUS_CREDS], name, strlen(name));
+}
+
+void engine_bus_names_changed(struct engine *e)
+{
+    cache_clear(e->caches[CACHE_BUS_CREDS]);
+}
+
+void engine_get_footprint(struct engine *e, struct engine_footprint *fp)
+{
+    uint32_t n_actions, n_groups, words;
+
+    memset(fp, 0, sizeof(struct engine_footprint));
+
+    fp->scratch_bytes = e->max_gids * sizeof(gid_t);
+
+    if (!e->policy)
+        return;
+
+    n_actions = policy_n_actions(e->policy);
+    n_groups = policy_n_groups(e->policy);
+    words = policy_action_words(e->policy);
+
+    policy_blob(e->policy, &fp->policy_bytes);
+    fp->strings_bytes = policy_strings_size(e->policy);
+
+    /* the arrays have one extra item, see engine_set_policy() */
+    fp->state_bytes = (n_groups + 1) * sizeof(struct resolved_group)
+            + (n_actions + 1) * (sizeof(uint64_t) + sizeof(uint8_t));
+
+    if (e->gid_index)
+        fp->gid_index_bytes = (n_groups + 1) * sizeof(struct gid_actions)
+                + e->n_gid_index * (words + 1) * sizeof(uint32_t);
+
+    fp->scratch_bytes += (words + 1) * sizeof(uint32_t);
+}
+
+bool engine_check(struct engine *e, const struct subject *subject,
+        const char *action_id, enum validity *validity)
+{
+    const uint32_t *groups;
+    uint32_t n_groups;
+    int action, r;
+    struct subject_creds sc;
+
+    /* The checks are ordered by cost: the policy lookups come first, and
+     * the credentials, which may need /proc or bus round trips, last. */
+
+    *validity = VALID_ANY_SUBJECT;
+    e->subject_uid = (uid_t) -1;
+
+    action = policy_find_action(e->policy, action_id);
+    if (action < 0) {
+        e->stats.short_circuited++;
+        return false;
+    }
+
+    e->action_requests[action]++;
+
+    if (classify_action(e, action) == ACTION_DENY_ALL) {
+        e->stats.short_circuited++;
+        return false;
+    }
+
+    *validity = VALID_NEVER;
+
+    /* check which groups the subject belongs to */
+
+    r = get_subject_creds(e, subject, &sc);
+    if (r < 0)
+        return false;
+
+    e->subject_uid = sc.uid;
+
+    /* The groups of a process may be changed by exec(), so its credentials
+     * are trusted only for a while. A unique bus name keeps the credentials
+     * it connected with, and a session keeps its user. */
+    if (subject->kind == SUBJECT_KIND_UNIX_PROCESS)
+        *validity = VALID_TIMEOUT;
+    else if (subject->kind == SUBJECT_KIND_UNIX_SESSION ||
+            subject->data.b.system_bus_name[0] == ':')
+        *validity = VALID_SUBJECT;
+
+    groups = policy_action_groups(e->policy, action, &n_groups);
+
+    return policy_action_allows(e->policy, action,
+            member_mask(e, groups, n_groups, &sc));
+}
+
+int engine_list(struct engine *e, const struct subject *subject,
+        const uint32_t **actions)
+{
+    struct subject_creds sc;
+    uint32_t n_actions = policy_n_actions(e->policy);
+    uint32_t words = policy_action_words(e->policy);
+    uint32_t *allowed = e->action_bits;
+    uint32_t a, w;
+    int r, j;
+
+    if (!e->gid_index) {
+        r = build_gid_index(e);
+        if (r < 0)
+            return r;
+    }
+
+    memset(allowed, 0, words * sizeof(uint32_t));
+    *actions = allowed;
+    e->subject_uid = (uid_t) -1;
+
+    /* A subject we can't get the credentials for isn't allowed anything,
+     * just like with engine_check(). */
+
+    r = get_subject_creds(e, subject, &sc);
+    if (r < 0)
+        return 0;
+
+    e->subject_uid = sc.uid;
+
+    for (j = 0; j < sc.n_gids; j++) {
+        const struct gid_actions *ga;
+
+        /* the primary gid doesn't count, see member_mask() */
+        if (sc.gids[j] == sc.primary_gid)
+            continue;
+
+        ga = find_gid_actions(e, sc.gids[j]);
+        if (!ga)
+            continue;
+
+        for (w = 0; w < words; w++)
+            allowed[w] |= ga->actions[w];
+    }
+
+    /* rules with other operators than "," are not in the index */
+    for (a = 0; a < n_actions; a++) {
+        const uint32_t *groups;
+        uint32_t n_groups;
+
+        if (policy_action_is_list(e->policy, a) ||
+                classify_action(e, a) == ACTION_DENY_ALL)
+            continue;
+
+        groups = policy_action_groups(e->policy, a, &n_groups);
+        if (policy_action_allows(e->policy, a, member_mask(e, groups, n_groups, &sc)))
+            allowed[a / 32] |= 1U << (a % 32);
+    }
+
+    return 0;
+}
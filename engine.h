@@ -0,0 +1,216 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+#ifndef GROUPCHECK_ENGINE_H
+#define GROUPCHECK_ENGINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "cache.h"
+#include "policy.h"
+
+/* The decision engine holds the compiled policy, the resolved groups and the
+ * credential caches, and answers the authorization questions. The facts
+ * about subjects and groups come from a provider: the daemon asks sd-bus,
+ * /proc, logind and NSS, while tests can plug in their own. */
+
+#define MAX_NAME_SIZE 256
+
+/* process credentials may change with exec(), so they are cached this long */
+#define PROCESS_CREDS_TTL_USEC 1000000ULL
+
+enum subject_kind {
+    SUBJECT_KIND_UNKNOWN = 0,
+    SUBJECT_KIND_UNIX_PROCESS,
+    SUBJECT_KIND_UNIX_SESSION,
+    SUBJECT_KIND_SYSTEM_BUS_NAME,
+};
+
+struct subject_unix_session {
+    char session_id[MAX_NAME_SIZE];
+};
+
+struct subject_unix_process {
+    uint32_t pid;
+    uint64_t start_time;
+};
+
+struct subject_system_bus {
+    char system_bus_name[MAX_NAME_SIZE];
+};
+
+struct subject {
+    enum subject_kind kind;
+    union {
+        struct subject_unix_session s;
+        struct subject_unix_process p;
+        struct subject_system_bus b;
+    } data;
+};
+
+/* How long a decision holds for the same subject, as long as the
+ * policy and the group database stay the same. */
+
+enum validity {
+    /* don't reuse the decision */
+    VALID_NEVER = 0,
+    /* for PROCESS_CREDS_TTL_USEC */
+    VALID_TIMEOUT,
+    /* for as long as the subject exists */
+    VALID_SUBJECT,
+    /* for every subject */
+    VALID_ANY_SUBJECT,
+};
+
+enum cache_type {
+    CACHE_BUS_CREDS = 0,
+    CACHE_PROCESS_CREDS,
+    CACHE_SESSION_UIDS,
+    CACHE_USER_GROUPS,
+    N_CACHES,
+};
+
+/* Credentials handed over by a provider. The provider stores at most
+ * max_gids gids to gids and sets n_gids to the real number of them. If they
+ * didn't fit, the engine asks again with a bigger array. */
+
+struct engine_creds {
+    /* the user, which is only reported, not checked */
+    uid_t uid;
+    gid_t primary_gid;
+    int n_gids;
+    int max_gids;
+    gid_t *gids;
+};
+
+/* The functions return 0 or a negative errno. */
+
+struct engine_provider {
+    /* Credentials of a process, which must still have the given start time
+     * and the same real and effective uid. */
+    int (*process_creds)(void *userdata, uint32_t pid, uint64_t start_time,
+            struct engine_creds *creds);
+
+    /* the current start time of a process, for subjects that give none */
+    int (*process_start_time)(void *userdata, uint32_t pid, uint64_t *start_time);
+
+    /* credentials of the owner of a bus name, with the same uid check */
+    int (*bus_name_creds)(void *userdata, const char *name,
+            struct engine_creds *creds);
+
+    int (*session_uid)(void *userdata, const char *session_id, uid_t *uid);
+
+    /* the primary group and the group list of a user */
+    int (*user_groups)(void *userdata, uid_t uid, struct engine_creds *creds);
+
+    /* -ENOENT if there is no such group */
+    int (*group_gid)(void *userdata, const char *name, gid_t *gid);
+};
+
+struct engine_stats {
+    /* denied without looking at the subject */
+    uint64_t short_circuited;
+};
+
+/* heap memory held by the engine, apart from the caches */
+struct engine_footprint {
+    /* the compiled policy, and the strings in it */
+    size_t policy_bytes;
+    size_t strings_bytes;
+    /* resolved groups, request counters and action classes */
+    size_t state_bytes;
+    size_t gid_index_bytes;
+    size_t scratch_bytes;
+};
+
+struct gid_actions;
+
+struct engine {
+    const struct engine_provider *provider;
+    void *userdata;
+
+    struct policy *policy;
+    /* the policy belongs to another engine, see engine_share_policy() */
+    bool policy_shared;
+    /* resolution state of each policy group */
+    struct resolved_group *groups;
+    /* number of requests for each policy action */
+    uint64_t *action_requests;
+    /* enum action_class of each policy action */
+    uint8_t *action_classes;
+    /* sorted by gid, built from the resolved groups; NULL when stale */
+    struct gid_actions *gid_index;
+    uint32_t n_gid_index;
+
+    struct cache *caches[N_CACHES];
+    struct engine_stats stats;
+
+    /* Scratch space of a request. It is kept between requests, so that
+     * requests don't allocate once it has grown to size. */
+    gid_t *gids;
+    int max_gids;
+    uint32_t *action_bits;
+    /* the user of the subject of the last request, or (uid_t) -1 if its
+     * credentials weren't needed */
+    uid_t subject_uid;
+};
+
+/* The budget must outlive the engine. */
+int engine_init(struct engine *e, const struct engine_provider *provider,
+        void *userdata, struct cache_budget *budget);
+void engine_done(struct engine *e);
+
+/* Take over the policy and, if they are not NULL, the resolved groups and
+ * request counters that belong to it. The policy is freed with the engine
+ * even if this fails. */
+int engine_set_policy(struct engine *e, struct policy *policy,
+        struct resolved_group *groups, uint64_t *action_requests);
+
+/* Switch to another policy, keeping the request counters of the actions
+ * that are in both. The old policy is kept if this fails. */
+int engine_replace_policy(struct engine *e, struct policy *policy);
+
+/* Use the policy of another engine, starting from its resolved groups. The
+ * policy isn't copied, so the other engine must keep it for as long as this
+ * one uses it. The engines can then be used from different threads. */
+int engine_share_policy(struct engine *e, const struct engine *from);
+
+/* Add the request counters of an engine that shares the policy to this
+ * one, and reset them there. */
+void engine_merge_counters(struct engine *e, struct engine *from);
+
+/* Resolve the groups of all actions and build the gid index, instead of
+ * doing it on the first requests. */
+void engine_prepare(struct engine *e);
+
+/* invalidation */
+void engine_groups_changed(struct engine *e);
+void engine_sessions_changed(struct engine *e);
+void engine_bus_name_gone(struct engine *e, const char *name);
+/* when it isn't known which bus names are gone */
+void engine_bus_names_changed(struct engine *e);
+
+void engine_get_footprint(struct engine *e, struct engine_footprint *fp);
+
+bool engine_check(struct engine *e, const struct subject *subject,
+        const char *action_id, enum validity *validity);
+
+/* Find the actions that the subject is allowed to do. The bitmap has
+ * policy_action_words() words and is valid until the next call. */
+int engine_list(struct engine *e, const struct subject *subject,
+        const uint32_t **actions);
+
+#endif /* GROUPCHECK_ENGINE_H */
@@ -0,0 +1,323 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "groupcheck-client.h"
+
+#define AUTHORITY_NAME "org.freedesktop.PolicyKit1"
+#define AUTHORITY_PATH "/org/freedesktop/PolicyKit1/Authority"
+#define AUTHORITY_INTERFACE "org.freedesktop.PolicyKit1.Authority"
+
+#define HINTS_DETAIL "groupcheck.cache-hints"
+#define HINT_GENERATION "groupcheck.generation"
+#define HINT_VALID_USEC "groupcheck.valid-usec"
+#define HINT_ANY_SUBJECT "groupcheck.any-subject"
+
+#define MAX_NAME_SIZE 256
+#define MAX_ENTRIES 32
+#define GENERATION_SIZE 32
+
+/* expiry time of entries that are valid until invalidated */
+#define NEVER_EXPIRES UINT64_MAX
+
+struct entry {
+    bool used;
+    bool allowed;
+    /* the decision is the same for every bus name */
+    bool any_subject;
+    uint64_t expires;
+    uint64_t last_used;
+    char bus_name[MAX_NAME_SIZE];
+    char action_id[MAX_NAME_SIZE];
+};
+
+struct groupcheck_client {
+    sd_bus *bus;
+    sd_bus_slot *changed_slot;
+    sd_bus_slot *owner_slot;
+    /* generation of the cached decisions */
+    char generation[GENERATION_SIZE];
+    struct entry entries[MAX_ENTRIES];
+};
+
+/* what the authority said about a decision */
+struct hints {
+    const char *generation;
+    const char *valid_usec;
+    bool any_subject;
+};
+
+static uint64_t now_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000ULL + (uint64_t) ts.tv_nsec / 1000ULL;
+}
+
+static void flush(struct groupcheck_client *c)
+{
+    memset(c->entries, 0, sizeof(c->entries));
+    c->generation[0] = '\0';
+}
+
+static int on_changed(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    flush(userdata);
+
+    return 0;
+}
+
+static int on_name_owner_changed(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    struct groupcheck_client *c = userdata;
+    const char *name, *old_owner, *new_owner;
+    int i, r;
+
+    r = sd_bus_message_read(m, "sss", &name, &old_owner, &new_owner);
+    if (r < 0)
+        return 0;
+
+    /* a new authority may decide differently */
+    if (strcmp(name, AUTHORITY_NAME) == 0) {
+        flush(c);
+        return 0;
+    }
+
+    /* a unique name that went away will never come back */
+    if (name[0] != ':' || new_owner[0] != '\0')
+        return 0;
+
+    for (i = 0; i < MAX_ENTRIES; i++) {
+        if (c->entries[i].used && strcmp(c->entries[i].bus_name, name) == 0)
+            c->entries[i].used = false;
+    }
+
+    return 0;
+}
+
+int groupcheck_client_new(sd_bus *bus, struct groupcheck_client **ret)
+{
+    struct groupcheck_client *c;
+    int r;
+
+    c = calloc(1, sizeof(struct groupcheck_client));
+    if (!c)
+        return -ENOMEM;
+
+    c->bus = sd_bus_ref(bus);
+
+    r = sd_bus_add_match(bus, &c->changed_slot,
+            "type='signal',sender='" AUTHORITY_NAME "',"
+            "path='" AUTHORITY_PATH "',"
+            "interface='" AUTHORITY_INTERFACE "',member='Changed'",
+            on_changed, c);
+    if (r < 0)
+        goto fail;
+
+    r = sd_bus_add_match(bus, &c->owner_slot,
+            "type='signal',sender='org.freedesktop.DBus',"
+            "interface='org.freedesktop.DBus',member='NameOwnerChanged'",
+            on_name_owner_changed, c);
+    if (r < 0)
+        goto fail;
+
+    *ret = c;
+    return 0;
+
+fail:
+    groupcheck_client_free(c);
+    return r;
+}
+
+void groupcheck_client_free(struct groupcheck_client *c)
+{
+    if (!c)
+        return;
+
+    sd_bus_slot_unref(c->changed_slot);
+    sd_bus_slot_unref(c->owner_slot);
+    sd_bus_unref(c->bus);
+    free(c);
+}
+
+static struct entry *find_entry(struct groupcheck_client *c, const char *bus_name,
+        const char *action_id, uint64_t now)
+{
+    int i;
+
+    for (i = 0; i < MAX_ENTRIES; i++) {
+        struct entry *e = &c->entries[i];
+
+        if (!e->used || strcmp(e->action_id, action_id) != 0)
+            continue;
+
+        if (!e->any_subject && strcmp(e->bus_name, bus_name) != 0)
+            continue;
+
+        if (e->expires <= now) {
+            e->used = false;
+            continue;
+        }
+
+        return e;
+    }
+
+    return NULL;
+}
+
+static void store_entry(struct groupcheck_client *c, const char *bus_name,
+        const char *action_id, bool allowed, const struct hints *h, uint64_t now)
+{
+    struct entry *e = &c->entries[0];
+    uint64_t expires;
+    char *end;
+    int i;
+
+    /* not groupcheck, or an old version of it */
+    if (!h->generation || !h->valid_usec)
+        return;
+
+    if (strcmp(h->valid_usec, "infinity") == 0) {
+        expires = NEVER_EXPIRES;
+    }
+    else {
+        errno = 0;
+        expires = strtoull(h->valid_usec, &end, 10);
+        if (errno != 0 || *end != '\0' || expires == 0)
+            return;
+        expires += now;
+    }
+
+    if (strlen(bus_name) >= MAX_NAME_SIZE || strlen(action_id) >= MAX_NAME_SIZE ||
+            strlen(h->generation) >= GENERATION_SIZE)
+        return;
+
+    /* the decisions made with another policy or groups are stale */
+    if (strcmp(c->generation, h->generation) != 0) {
+        flush(c);
+        strcpy(c->generation, h->generation);
+    }
+
+    /* take a free slot, or the least recently used one */
+    for (i = 0; i < MAX_ENTRIES; i++) {
+        if (!c->entries[i].used) {
+            e = &c->entries[i];
+            break;
+        }
+
+        if (c->entries[i].last_used < e->last_used)
+            e = &c->entries[i];
+    }
+
+    e->used = true;
+    e->allowed = allowed;
+    e->any_subject = h->any_subject;
+    e->expires = expires;
+    e->last_used = now;
+    strcpy(e->bus_name, bus_name);
+    strcpy(e->action_id, action_id);
+}
+
+static int read_details(sd_bus_message *reply, struct hints *h)
+{
+    int r;
+
+    r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_ARRAY, "{ss}");
+    if (r < 0)
+        return r;
+
+    while ((r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_DICT_ENTRY, "ss")) > 0) {
+        const char *key;
+        const char *value;
+
+        r = sd_bus_message_read(reply, "ss", &key, &value);
+        if (r < 0)
+            return r;
+
+        if (strcmp(key, HINT_GENERATION) == 0)
+            h->generation = value;
+        else if (strcmp(key, HINT_VALID_USEC) == 0)
+            h->valid_usec = value;
+        else if (strcmp(key, HINT_ANY_SUBJECT) == 0)
+            h->any_subject = strcmp(value, "1") == 0;
+
+        /* dict entry */
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+            return r;
+    }
+
+    if (r < 0)
+        return r;
+
+    /* array */
+    return sd_bus_message_exit_container(reply);
+}
+
+int groupcheck_client_check(struct groupcheck_client *c, const char *bus_name,
+        const char *action_id)
+{
+    sd_bus_error error = SD_BUS_ERROR_NULL;
+    sd_bus_message *reply = NULL;
+    struct hints h = { 0 };
+    struct entry *e;
+    uint64_t now = now_usec();
+    int allowed, challenge;
+    int r;
+
+    e = find_entry(c, bus_name, action_id, now);
+    if (e) {
+        e->last_used = now;
+        return e->allowed;
+    }
+
+    r = sd_bus_call_method(c->bus, AUTHORITY_NAME, AUTHORITY_PATH,
+            AUTHORITY_INTERFACE, "CheckAuthorization", &error, &reply,
+            "(sa{sv})sa{ss}us",
+            "system-bus-name", 1, "name", "s", bus_name,
+            action_id,
+            1, HINTS_DETAIL, "1",
+            0, "");
+    if (r < 0)
+        goto end;
+
+    r = sd_bus_message_enter_container(reply, SD_BUS_TYPE_STRUCT, "bba{ss}");
+    if (r < 0)
+        goto end;
+
+    r = sd_bus_message_read(reply, "bb", &allowed, &challenge);
+    if (r < 0)
+        goto end;
+
+    r = read_details(reply, &h);
+    if (r < 0)
+        goto end;
+
+    store_entry(c, bus_name, action_id, allowed, &h, now);
+
+    r = allowed ? 1 : 0;
+
+end:
+    sd_bus_error_free(&error);
+    sd_bus_message_unref(reply);
+    return r;
+}
@@ -0,0 +1,41 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+#ifndef GROUPCHECK_CLIENT_H
+#define GROUPCHECK_CLIENT_H
+
+#include <systemd/sd-bus.h>
+
+/* Authorization checks for D-Bus services, with a small cache that follows
+ * the cacheability hints of groupcheck. A service asks whether the sender of
+ * a method call may do an action, and repeated questions about the same
+ * sender and action are answered locally for as long as the hints allow.
+ * The cache is flushed when the authority emits Changed or changes owners,
+ * and entries of a bus name are dropped when the name goes away.
+ *
+ * With an authority that gives no hints, such as polkit itself, nothing is
+ * cached. The cache is only updated while the bus connection is processed,
+ * for example by attaching it to an sd-event loop. */
+
+struct groupcheck_client;
+
+int groupcheck_client_new(sd_bus *bus, struct groupcheck_client **ret);
+void groupcheck_client_free(struct groupcheck_client *c);
+
+/* Returns 1 if the owner of the bus name is allowed to do the action, 0 if
+ * not, or a negative errno if the authority couldn't be asked. */
+int groupcheck_client_check(struct groupcheck_client *c, const char *bus_name,
+        const char *action_id);
+
+#endif /* GROUPCHECK_CLIENT_H */
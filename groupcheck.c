@@ -14,264 +14,493 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <getopt.h>
 #include <grp.h>
+#include <pwd.h>
+#include <signal.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
 
 #include <systemd/sd-bus.h>
 #include <systemd/sd-event.h>
-
-#define LINE_BUF_SIZE 512
-#define MAX_NAME_SIZE 256
-#define MAX_GROUPS 10
-
-/* file parser results */
-
-struct line_data {
-    char buf[LINE_BUF_SIZE];
-    char *id;
-    int n_groups;
-    char *groups[MAX_GROUPS];
-};
-
-/* D-Bus message analysis */
-
-enum subject_kind {
-    SUBJECT_KIND_UNKNOWN = 0,
-    SUBJECT_KIND_UNIX_PROCESS,
-    SUBJECT_KIND_UNIX_SESSION,
-    SUBJECT_KIND_SYSTEM_BUS_NAME,
-};
-
-struct subject_unix_session {
-    char session_id[MAX_NAME_SIZE];
+#include <systemd/sd-daemon.h>
+#include <systemd/sd-login.h>
+
+#include "actions.h"
+#include "alloc.h"
+#include "cache.h"
+#include "engine.h"
+#include "heavy.h"
+#include "policy.h"
+#include "snapshot.h"
+
+#define SERVICE_NAME "org.freedesktop.PolicyKit1"
+#define AUTHORITY_PATH "/org/freedesktop/PolicyKit1/Authority"
+#define AUTHORITY_INTERFACE "org.freedesktop.PolicyKit1.Authority"
+
+/* default memory budget shared by all caches, in bytes */
+#define DEFAULT_CACHE_BUDGET (128*1024)
+
+/* Anybody may connect to the socket for direct connections by default, as
+ * anybody may call the authority on the system bus. */
+#define DEFAULT_LISTEN_MODE 0666
+
+/* Caches shrink to this percentage of the budget under memory pressure. */
+#define CACHE_LOW_WATER_PERCENT 25
+
+/* Memory pressure trigger: 150 ms of partial stall within a 2 s window.
+ * Unprivileged processes may only use windows that are multiples of 2 s. */
+#define PRESSURE_FILE "/proc/pressure/memory"
+#define PRESSURE_TRIGGER "some 150000 2000000"
+
+#define GROUP_FILE_DIR "/etc"
+#define GROUP_FILE_NAME "group"
+#define GROUP_FILE GROUP_FILE_DIR "/" GROUP_FILE_NAME
+
+/* opt-in request detail for the cacheability hints in the reply */
+#define HINTS_DETAIL "groupcheck.cache-hints"
+#define HINT_GENERATION "groupcheck.generation"
+#define HINT_VALID_USEC "groupcheck.valid-usec"
+#define HINT_ANY_SUBJECT "groupcheck.any-subject"
+
+/* restart-safe state is kept here between daemon instances */
+#define STATE_DIR "/run/groupcheck"
+#define STATE_FILE STATE_DIR "/state"
+
+/* name of the state memfd in the systemd file descriptor store */
+#define FDSTORE_STATE_NAME "state"
+
+/* peers connect with the D-Bus protocol but without a bus, like this */
+#define PEER_DISCONNECTED_MATCH "type='signal',path='/org/freedesktop/DBus/Local'," \
+        "interface='org.freedesktop.DBus.Local',member='Disconnected'"
+
+/* requests queued while loading are kept in preallocated slots first */
+#define PENDING_POOL_SIZE 32
+
+/* Heavy hitters: counters for the busiest senders, subject uids and
+ * actions, both by requests and by the time spent on them. The weights are
+ * halved every HEAVY_HALF_LIFE_USEC, so they show the recent load. */
+#define HEAVY_CAPACITY 16
+#define HEAVY_REPORT_SIZE 5
+#define HEAVY_HALF_LIFE_USEC (60 * 1000000ULL)
+
+enum heavy_kind {
+    HEAVY_SENDERS = 0,
+    HEAVY_UIDS,
+    HEAVY_ACTIONS,
+    HEAVY_SENDER_USEC,
+    HEAVY_UID_USEC,
+    HEAVY_ACTION_USEC,
+    N_HEAVY,
 };
 
-struct subject_unix_process {
-    uint32_t pid;
-    uint64_t start_time;
-};
-
-struct subject_system_bus {
-    char system_bus_name[MAX_NAME_SIZE];
-};
-
-struct subject {
-    enum subject_kind kind;
-    union {
-        struct subject_unix_session s;
-        struct subject_unix_process p;
-        struct subject_system_bus b;
-    } data;
+static const char *heavy_names[N_HEAVY] = {
+    [HEAVY_SENDERS] = "senders",
+    [HEAVY_UIDS] = "uids",
+    [HEAVY_ACTIONS] = "actions",
+    [HEAVY_SENDER_USEC] = "sender-usec",
+    [HEAVY_UID_USEC] = "uid-usec",
+    [HEAVY_ACTION_USEC] = "action-usec",
 };
 
 #define STAT_NAME_SIZE 32
-#define STAT_DATA_SIZE 256
+#define STAT_DATA_SIZE 512
 
-static int verify_start_time(struct subject *subject)
+static int read_start_time(uint32_t pid, uint64_t *start_time)
 {
-    /* Get the pid start time from /proc/stat and compare it with the value in
-     * the request. Return -1 if no match. */
+    /* Get the pid start time from /proc/stat. */
 
     char namebuf[STAT_NAME_SIZE];
     char databuf[STAT_DATA_SIZE];
-    int r;
-    FILE *f;
+    int r, fd;
+    ssize_t len;
     char *p, *endp = NULL;
     int i;
-    uint64_t start_time;
+    uint64_t value;
 
-    r = snprintf(namebuf, STAT_NAME_SIZE, "/proc/%d/stat", subject->data.p.pid);
+    r = snprintf(namebuf, STAT_NAME_SIZE, "/proc/%u/stat", pid);
     if (r < 0 || r >= STAT_NAME_SIZE)
         return -EINVAL;
 
-    f = fopen(namebuf, "r");
-
-    if (f == NULL)
+    /* plain read(), stdio would allocate a buffer for every request */
+    fd = open(namebuf, O_RDONLY|O_CLOEXEC);
+    if (fd < 0)
         return -EINVAL;
 
-    p = fgets(databuf, STAT_DATA_SIZE, f);
-    if (p == NULL)
+    len = read(fd, databuf, STAT_DATA_SIZE - 1);
+    close(fd);
+    if (len <= 0)
         return -EINVAL;
 
-    /* read the 22th field, which is the process start time in jiffies */
+    databuf[len] = '\0';
 
-    /* skip over the "comm" field that has parentheses */
-    p = strchr(p, ')');
+    /* read the 22th field, which is the process start time in jiffies */
 
-    if (*p == '\0')
+    /* skip over the "comm" field that has parentheses, and which may
+     * contain spaces and parentheses itself */
+    p = strrchr(databuf, ')');
+    if (p == NULL)
         return -EINVAL;
 
     /* That was the second field. Then skip over 19 more (20 spaces). */
 
     for (i = 0; i < 20; i++) {
         p = strchr(p, ' ');
-        if (*p == '\0')
+        if (p == NULL)
             return -EINVAL;
+        p++;
     }
 
-    start_time = strtoul(p, &endp, 10);
-    if (endp != NULL)
+    errno = 0;
+    value = strtoull(p, &endp, 10);
+    if (errno != 0 || endp == p || (*endp != ' ' && *endp != '\n' && *endp != '\0'))
         return -EINVAL;
 
-    if (start_time != subject->data.p.start_time)
+    *start_time = value;
+
+    return 0;
+}
+
+static int verify_start_time(uint32_t pid, uint64_t start_time)
+{
+    /* Compare the pid start time with the value in the request. */
+
+    uint64_t value;
+    int r;
+
+    r = read_start_time(pid, &value);
+    if (r < 0)
+        return r;
+
+    if (value != start_time)
         return -EINVAL;
 
     /* start times match */
     return 0;
 }
 
-static bool check_allowed(sd_bus *bus, struct line_data *data,
-        struct subject *subject, const char *action_id)
+/* daemon state shared by the D-Bus handlers */
+
+struct statistics {
+    uint64_t requests;
+    uint64_t queued_requests;
+    uint64_t allowed;
+    uint64_t denied;
+    uint64_t policy_reloads;
+    uint64_t changed_signals;
+    uint64_t list_requests;
+    uint64_t pressure_events;
+    uint64_t cache_bytes_reclaimed;
+    uint64_t heap_bytes_trimmed;
+};
+
+enum load_state {
+    LOAD_PENDING = 0,
+    LOAD_DONE,
+    LOAD_FAILED,
+};
+
+/* a request that came in before the policy was loaded */
+
+struct pending_request {
+    struct pending_request *next;
+    sd_bus_message *m;
+    sd_bus_message_handler_t handler;
+};
+
+struct workers;
+struct worker;
+
+struct context {
+    /* The policy is loaded in a separate thread while the daemon already
+     * owns its bus name. Until the loader is done, requests are queued. The
+     * fields below load_state are only touched by the loader until then. */
+    enum load_state load_state;
+    pthread_t loader;
+    bool loader_running;
+    int loaded_fd;
+    int load_result;
+    bool groups_changed;
+    struct pending_request *pending_head;
+    struct pending_request *pending_tail;
+    struct pending_request *pending_free;
+    struct pending_request pending_pool[PENDING_POOL_SIZE];
+
+    const char *policy_file;
+    /* the policy, the resolved groups and the credential caches */
+    struct engine engine;
+    /* where the polkit action descriptions are, for EnumerateActions */
+    struct action_index *action_index;
+    bool warm_start;
+    /* set if the loaded policy or groups may differ from what the previous
+     * instance used */
+    bool state_changed;
+    int state_fd;
+    /* Identities of the files that the policy and the groups were read
+     * from, taken before reading them. They go into the snapshot, and the
+     * group file one tells real changes from repeated notifications. */
+    struct file_identity policy_file_id;
+    struct file_identity group_file_id;
+    uint64_t group_generation;
+    /* changes whenever the compiled policy or the group file changes; the
+     * same inputs give the same value across restarts */
+    uint64_t generation;
+    sd_bus *bus;
+    /* exit after this many microseconds without requests, 0 for never */
+    uint64_t idle_timeout;
+    uint64_t last_activity;
+    struct cache_budget *budget;
+    struct statistics stats;
+    int pressure_fd;
+    sd_login_monitor *login_monitor;
+    /* the threads serving the peer-to-peer socket, if there is one */
+    struct workers *workers;
+    /* set in the contexts of those threads */
+    struct worker *worker;
+    struct heavy_hitters *heavy[N_HEAVY];
+};
+
+/* The subject facts for the engine come from the system. The sd-bus
+ * credential objects are dropped right away, the engine copies the gids. */
+
+static int copy_bus_creds(sd_bus_creds *c, struct engine_creds *creds)
 {
-    struct line_data *line;
-    char **groups = NULL;
-    int n_groups = 0;
-    int r;
-    sd_bus_creds *creds = NULL;
-    gid_t primary_gid;
-    uint64_t mask = SD_BUS_CREDS_SUPPLEMENTARY_GIDS | SD_BUS_CREDS_AUGMENT
-            | SD_BUS_CREDS_PID | SD_BUS_CREDS_GID;
-    const gid_t *gids = NULL;
-    int n_gids = 0;
-    pid_t ruid, euid;
+    const gid_t *gids;
+    uid_t ruid, euid;
+    int r, n;
+
+    r = sd_bus_creds_get_uid(c, &ruid);
+    if (r < 0)
+        return r;
+
+    r = sd_bus_creds_get_euid(c, &euid);
+    if (r < 0)
+        return r;
 
-    /* find first the corresponding group data from the policy */
+    /* We want the real uid to be the same as the effective uid. This helps
+     * to make sure that the original caller hasn't used exec() to start
+     * a setuid() process for which the effective user might belong to a
+     * different set of groups. */
 
-    line = data;
+    if (euid != ruid)
+        return -EPERM;
 
-    while (line->id) {
-        if (strcmp(line->id, action_id) == 0) {
-            groups = line->groups;
-            n_groups = line->n_groups;
-            break;
-        }
-        line++;
-    }
+    creds->uid = ruid;
 
-    if (!groups)
-        return false;
+    n = sd_bus_creds_get_supplementary_gids(c, &gids);
+    if (n < 0)
+        return n;
+
+    r = sd_bus_creds_get_gid(c, &creds->primary_gid);
+    if (r < 0)
+        return r;
 
-    /* check which groups the subject belongs to */
+    memcpy(creds->gids, gids, (n < creds->max_gids ? n : creds->max_gids) * sizeof(gid_t));
+    creds->n_gids = n;
 
-    switch (subject->kind) {
-    case SUBJECT_KIND_UNIX_PROCESS:
+    return 0;
+}
+
+static int system_process_creds(void *userdata, uint32_t pid, uint64_t start_time,
+        struct engine_creds *creds)
+{
+    sd_bus_creds *c = NULL;
+    uint64_t mask;
+    int r;
 
 #if 0
-        if (subject->data.p.pid == 0) {
-            /* We don't authenticate requests coming from root to protect
-             * against attacks where the process exec()s a binary that is
-             * setuid root after asking for permissions. This is not needed if
-             * the root doesn't belong to any special groups though. It's the
-             * responsibility of the system administrator to make sure that
-             * there aren't any other UIDs that have setuid() binaries and
-             * belong to administrator groups. */
-            goto end;
-        }
+    if (pid == 0) {
+        /* We don't authenticate requests coming from root to protect
+         * against attacks where the process exec()s a binary that is
+         * setuid root after asking for permissions. This is not needed if
+         * the root doesn't belong to any special groups though. It's the
+         * responsibility of the system administrator to make sure that
+         * there aren't any other UIDs that have setuid() binaries and
+         * belong to administrator groups. */
+        return -EPERM;
+    }
 #endif
 
-        mask = _SD_BUS_CREDS_ALL;
-        r = sd_bus_creds_new_from_pid(&creds, subject->data.p.pid, mask);
-        if (r < 0)
-            goto end;
+    /* only what is checked below, every field is a separate /proc read */
+    mask = SD_BUS_CREDS_UID | SD_BUS_CREDS_EUID | SD_BUS_CREDS_GID
+            | SD_BUS_CREDS_SUPPLEMENTARY_GIDS;
+    r = sd_bus_creds_new_from_pid(&c, pid, mask);
+    if (r < 0)
+        return r;
 
-        r = verify_start_time(subject);
-        if (r < 0)
-            goto end;
+    r = verify_start_time(pid, start_time);
+    if (r < 0)
+        goto end;
 
-        r = sd_bus_creds_get_uid(creds, &ruid);
-        if (r < 0)
-            goto end;
+    r = copy_bus_creds(c, creds);
 
-        r = sd_bus_creds_get_euid(creds, &euid);
-        if (r < 0)
-            goto end;
+end:
+    sd_bus_creds_unref(c);
+    return r;
+}
 
-        /* We want the real uid to be the same as the effective uid. This helps
-         * to make sure that the original caller hasn't used exec() to start
-         * a setuid() process for which the effective user might belong to a
-         * different set of groups. */
+static int system_process_start_time(void *userdata, uint32_t pid,
+        uint64_t *start_time)
+{
+    return read_start_time(pid, start_time);
+}
 
-        if (euid != ruid)
-            goto end;
+static int worker_open_bus(struct worker *w);
 
-        n_gids = sd_bus_creds_get_supplementary_gids(creds, &gids);
-        if (n_gids < 0)
-            goto end;
+static int system_bus_name_creds(void *userdata, const char *name,
+        struct engine_creds *creds)
+{
+    struct context *ctx = userdata;
+    sd_bus_creds *c = NULL;
+    uint64_t mask = SD_BUS_CREDS_SUPPLEMENTARY_GIDS | SD_BUS_CREDS_AUGMENT
+            | SD_BUS_CREDS_PID | SD_BUS_CREDS_UID | SD_BUS_CREDS_EUID
+            | SD_BUS_CREDS_GID;
+    int r;
 
-        r = sd_bus_creds_get_gid(creds, &primary_gid);
+    if (!ctx->bus && ctx->worker) {
+        r = worker_open_bus(ctx->worker);
         if (r < 0)
-            goto end;
+            return r;
+    }
 
-        break;
+    if (!ctx->bus)
+        return -ENOTCONN;
 
-    case SUBJECT_KIND_SYSTEM_BUS_NAME:
-        r = sd_bus_get_name_creds(bus, subject->data.b.system_bus_name, mask, &creds);
-        if (r < 0)
-            goto end;
+    r = sd_bus_get_name_creds(ctx->bus, name, mask, &c);
+    if (r < 0)
+        return r;
 
-        r = sd_bus_creds_get_uid(creds, &ruid);
-        if (r < 0)
-            goto end;
+    r = copy_bus_creds(c, creds);
 
-        r = sd_bus_creds_get_euid(creds, &euid);
-        if (r < 0)
-            goto end;
+    sd_bus_creds_unref(c);
+    return r;
+}
 
-        if (euid != ruid)
-            goto end;
+static int system_session_uid(void *userdata, const char *session_id, uid_t *uid)
+{
+    return sd_session_get_uid(session_id, uid);
+}
 
-        n_gids = sd_bus_creds_get_supplementary_gids(creds, &gids);
-        if (n_gids < 0)
-            goto end;
+/* The workers of the peer-to-peer socket ask from their own threads, so the
+ * reentrant NSS calls are used. Their buffer is on the stack unless an entry
+ * doesn't fit. */
 
-        r = sd_bus_creds_get_gid(creds, &primary_gid);
-        if (r < 0)
-            goto end;
+#define NSS_BUFFER_SIZE 4096
 
-        break;
+static char *grow_nss_buffer(char *buf, char *stack_buf, size_t *size)
+{
+    char *bigger;
 
-    default:
-        /* not supported yet */
-        break;
+    *size *= 2;
+    bigger = buf == stack_buf ? malloc(*size) : realloc(buf, *size);
+    if (!bigger && buf != stack_buf)
+        free(buf);
+
+    return bigger;
+}
+
+static int system_user_groups(void *userdata, uid_t uid, struct engine_creds *creds)
+{
+    struct passwd pwbuf, *pw = NULL;
+    char stack_buf[NSS_BUFFER_SIZE], *buf = stack_buf;
+    size_t size = sizeof(stack_buf);
+    int n = creds->max_gids;
+
+    while (getpwuid_r(uid, &pwbuf, buf, size, &pw) == ERANGE) {
+        buf = grow_nss_buffer(buf, stack_buf, &size);
+        if (!buf)
+            return -ENOMEM;
     }
 
-    if (gids) {
-        int i, j;
-        struct group *grp;
+    if (!pw) {
+        if (buf != stack_buf)
+            free(buf);
+        return -ESRCH;
+    }
 
-        /* match the groups */
+    creds->uid = uid;
+    creds->primary_gid = pw->pw_gid;
 
-        for (i = 0; i < n_groups; i++) {
-            grp = getgrnam(groups[i]);
-            if (grp == NULL)
-                continue;
+    /* if the groups don't fit, n is the real number of them */
+    getgrouplist(pw->pw_name, pw->pw_gid, creds->gids, &n);
+    creds->n_gids = n;
 
-            for (j = 0; j < n_gids; j++) {
+    if (buf != stack_buf)
+        free(buf);
 
-                if (gids[j] == primary_gid) {
-                    /* We only include supplementary gids in the check, not the
-                       primary gid. This is to make it more difficult for
-                       processes to exec a setgid process to gain elevated
-                       group access. */
-                       continue;
-                }
+    return 0;
+}
 
-                if (gids[j] == grp->gr_gid) {
-                    sd_bus_creds_unref(creds);
-                    /* the subject belongs to one of the groups defined in policy */
-                    return true;
-                }
-            }
-        }
+static int system_group_gid(void *userdata, const char *name, gid_t *gid)
+{
+    struct group grbuf, *grp = NULL;
+    char stack_buf[NSS_BUFFER_SIZE], *buf = stack_buf;
+    size_t size = sizeof(stack_buf);
+
+    while (getgrnam_r(name, &grbuf, buf, size, &grp) == ERANGE) {
+        buf = grow_nss_buffer(buf, stack_buf, &size);
+        if (!buf)
+            return -ENOMEM;
     }
 
-end:
-    sd_bus_creds_unref(creds);
-    return false;
+    if (grp)
+        *gid = grp->gr_gid;
+
+    if (buf != stack_buf)
+        free(buf);
+
+    return grp ? 0 : -ENOENT;
+}
+
+static const struct engine_provider system_provider = {
+    .process_creds = system_process_creds,
+    .process_start_time = system_process_start_time,
+    .bus_name_creds = system_bus_name_creds,
+    .session_uid = system_session_uid,
+    .user_groups = system_user_groups,
+    .group_gid = system_group_gid,
+};
+
+static uint64_t hash_bytes(const void *data, size_t size, uint64_t h)
+{
+    /* FNV-1a */
+    const unsigned char *p = data;
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+static void update_generation(struct context *ctx)
+{
+    const void *blob;
+    size_t size;
+    uint64_t h = 14695981039346656037ULL;
+
+    blob = policy_blob(ctx->engine.policy, &size);
+    h = hash_bytes(blob, size, h);
+
+    h = hash_bytes(&ctx->group_file_id, sizeof(ctx->group_file_id), h);
+
+    ctx->generation = h;
 }
 
 static int parse_subject(sd_bus_message *m, struct subject *subject)
@@ -288,9 +517,9 @@ static int parse_subject(sd_bus_message *m, struct subject *subject)
     if (r < 0)
         return r;
 
-    /* There are three known subject types in polkit: proces, session, and
-     * D-Bus name. We parse them all, but support only process and D-Bus based
-     * authentication. */
+    /* There are three known subject types in polkit: process, session, and
+     * D-Bus name. All three are supported; a session subject is checked
+     * against the user owning the session. */
 
     if (strcmp(subject_kind, "unix-process") == 0)
         subject->kind = SUBJECT_KIND_UNIX_PROCESS;
@@ -358,7 +587,7 @@ static int parse_subject(sd_bus_message *m, struct subject *subject)
                     return r;
 
                 if (strlen(value) >= MAX_NAME_SIZE)
-                    return r;
+                    return -EINVAL;
 
                 strncpy(subject->data.s.session_id, value, MAX_NAME_SIZE);
 
@@ -435,6 +664,149 @@ static void print_decision(struct subject *subject, const char *action_id, bool
     }
 }
 
+static int queue_request(struct context *ctx, sd_bus_message *m,
+        sd_bus_message_handler_t handler)
+{
+    struct pending_request *p;
+
+    if (ctx->load_state == LOAD_FAILED)
+        return sd_bus_reply_method_errorf(m, SD_BUS_ERROR_FAILED,
+                "Policy could not be loaded");
+
+    /* the pool covers the usual startup burst, the heap the rest */
+    p = ctx->pending_free;
+    if (p)
+        ctx->pending_free = p->next;
+    else
+        p = malloc(sizeof(struct pending_request));
+    if (!p)
+        return -ENOMEM;
+
+    /* the handler is run again with the message once the policy is there */
+    p->m = sd_bus_message_ref(m);
+    p->handler = handler;
+    p->next = NULL;
+
+    if (ctx->pending_tail)
+        ctx->pending_tail->next = p;
+    else
+        ctx->pending_head = p;
+    ctx->pending_tail = p;
+
+    ctx->stats.queued_requests++;
+
+    return 1;
+}
+
+static int append_hints(sd_bus_message *reply, uint64_t generation,
+        enum validity validity)
+{
+    char buf[32];
+    const char *valid_usec;
+    int r;
+
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long) generation);
+
+    r = sd_bus_message_append(reply, "{ss}", HINT_GENERATION, buf);
+    if (r < 0)
+        return r;
+
+    switch (validity) {
+    case VALID_TIMEOUT:
+        snprintf(buf, sizeof(buf), "%llu", PROCESS_CREDS_TTL_USEC);
+        valid_usec = buf;
+        break;
+    case VALID_SUBJECT:
+    case VALID_ANY_SUBJECT:
+        valid_usec = "infinity";
+        break;
+    default:
+        valid_usec = "0";
+        break;
+    }
+
+    r = sd_bus_message_append(reply, "{ss}", HINT_VALID_USEC, valid_usec);
+    if (r < 0)
+        return r;
+
+    if (validity == VALID_ANY_SUBJECT) {
+        r = sd_bus_message_append(reply, "{ss}", HINT_ANY_SUBJECT, "1");
+        if (r < 0)
+            return r;
+    }
+
+    return 0;
+}
+
+static int new_heavy_hitters(struct context *ctx)
+{
+    int i;
+
+    for (i = 0; i < N_HEAVY; i++) {
+        ctx->heavy[i] = heavy_hitters_new(HEAVY_CAPACITY);
+        if (!ctx->heavy[i])
+            return -ENOMEM;
+    }
+
+    return 0;
+}
+
+static void free_heavy_hitters(struct context *ctx)
+{
+    int i;
+
+    for (i = 0; i < N_HEAVY; i++) {
+        heavy_hitters_free(ctx->heavy[i]);
+        ctx->heavy[i] = NULL;
+    }
+}
+
+static void track_request(struct context *ctx, sd_bus_message *m,
+        const char *action_id, uint64_t start)
+{
+    uint64_t usec = cache_now() - start;
+    const char *sender;
+    char uid[16];
+
+    /* direct connections have no sender, but a description of the peer */
+    sender = sd_bus_message_get_sender(m);
+    if (!sender && sd_bus_get_description(sd_bus_message_get_bus(m), &sender) < 0)
+        sender = "unknown";
+
+    heavy_hitters_add(ctx->heavy[HEAVY_SENDERS], sender, 1);
+    heavy_hitters_add(ctx->heavy[HEAVY_SENDER_USEC], sender, usec);
+
+    /* the subject wasn't looked up if the policy alone decided */
+    if (ctx->engine.subject_uid != (uid_t) -1) {
+        snprintf(uid, sizeof(uid), "%u", (unsigned int) ctx->engine.subject_uid);
+        heavy_hitters_add(ctx->heavy[HEAVY_UIDS], uid, 1);
+        heavy_hitters_add(ctx->heavy[HEAVY_UID_USEC], uid, usec);
+    }
+
+    if (action_id) {
+        heavy_hitters_add(ctx->heavy[HEAVY_ACTIONS], action_id, 1);
+        heavy_hitters_add(ctx->heavy[HEAVY_ACTION_USEC], action_id, usec);
+    }
+}
+
+static void report_heavy_hitters(struct context *ctx)
+{
+    struct heavy_entry top[HEAVY_REPORT_SIZE];
+    unsigned int n, j;
+    int i;
+
+    for (i = 0; i < N_HEAVY; i++) {
+        n = heavy_hitters_top(ctx->heavy[i], top, HEAVY_REPORT_SIZE);
+        if (n == 0)
+            continue;
+
+        fprintf(stdout, "  top %s:", heavy_names[i]);
+        for (j = 0; j < n; j++)
+            fprintf(stdout, " %s=%llu", top[j].key, (unsigned long long) top[j].weight);
+        fprintf(stdout, "\n");
+    }
+}
+
 static int method_check_authorization(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
 {
     int r;
@@ -444,7 +816,10 @@ static int method_check_authorization(sd_bus_message *m, void *userdata, sd_bus_
     struct subject subject = { 0 };
     sd_bus_message *reply = NULL;
     bool allowed;
-    struct line_data *data = userdata;
+    bool hints = false;
+    enum validity validity;
+    struct context *ctx = userdata;
+    uint64_t start;
 
     /*
         ‣ Type=method_call  Endian=l  Flags=0  Version=1  Priority=0 Cookie=2860
@@ -472,6 +847,11 @@ static int method_check_authorization(sd_bus_message *m, void *userdata, sd_bus_
 
     /* fprintf(stdout, "Incoming CheckAuthorization message!\n"); */
 
+    if (ctx->load_state != LOAD_DONE)
+        return queue_request(ctx, m, method_check_authorization);
+
+    start = cache_now();
+
     r = parse_subject(m, &subject);
     if (r < 0) {
         fprintf(stderr, "Failed to parse subject\n");
@@ -500,6 +880,9 @@ static int method_check_authorization(sd_bus_message *m, void *userdata, sd_bus_
         if (r < 0)
             return r;
 
+        if (strcmp(key, HINTS_DETAIL) == 0 && strcmp(value, "1") == 0)
+            hints = true;
+
         /* dict entry */
         r = sd_bus_message_exit_container(m);
         if (r < 0)
@@ -521,7 +904,13 @@ static int method_check_authorization(sd_bus_message *m, void *userdata, sd_bus_
 
     /* make decision about whether the request should be allowed or not */
 
-    allowed = check_allowed(sd_bus_message_get_bus(m), data, &subject, action_id);
+    allowed = engine_check(&ctx->engine, &subject, action_id, &validity);
+
+    ctx->stats.requests++;
+    if (allowed)
+        ctx->stats.allowed++;
+    else
+        ctx->stats.denied++;
 
     print_decision(&subject, action_id, allowed);
 
@@ -542,6 +931,12 @@ static int method_check_authorization(sd_bus_message *m, void *userdata, sd_bus_
     if (r < 0)
         goto end;
 
+    if (hints) {
+        r = append_hints(reply, ctx->generation, validity);
+        if (r < 0)
+            goto end;
+    }
+
     /* array */
     r = sd_bus_message_close_container(reply);
     if (r < 0)
@@ -554,6 +949,8 @@ static int method_check_authorization(sd_bus_message *m, void *userdata, sd_bus_
 
     r = sd_bus_send(NULL, reply, NULL);
 
+    track_request(ctx, m, action_id, start);
+
 end:
     sd_bus_message_unref(reply);
     return r;
@@ -569,11 +966,15 @@ static int method_cancel_check_authorization(sd_bus_message *m, void *userdata,
 static int method_enumerate_actions(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
 {
     int r;
-    const char *locale;
+    const char *locale, *id, *annotation;
     sd_bus_message *reply = NULL;
-    struct line_data *line;
+    struct context *ctx = userdata;
+    struct action_details details;
+    uint32_t i;
+    int j;
 
-    line = userdata;
+    if (ctx->load_state != LOAD_DONE)
+        return queue_request(ctx, m, method_enumerate_actions);
 
     r = sd_bus_message_read(m, "s", &locale);
     if (r < 0)
@@ -587,13 +988,28 @@ static int method_enumerate_actions(sd_bus_message *m, void *userdata, sd_bus_er
     if (r < 0)
         goto end;
 
-    while (line->id) {
+    for (i = 0; i < policy_n_actions(ctx->engine.policy); i++) {
         r = sd_bus_message_open_container(reply, SD_BUS_TYPE_STRUCT, "ssssssuuua{ss}");
         if (r < 0)
             goto end;
 
-        /* just report the id and that authorization is required for all users */
-        r = sd_bus_message_append(reply, "ssssssuuu", line->id, "", "", "", "", "", 1, 1, 1);
+        id = policy_action_id(ctx->engine.policy, i);
+
+        if (action_index_lookup(ctx->action_index, id, locale, &details) < 0) {
+            /* no description installed: just report the id and that
+             * authorization is required for all users */
+            memset(&details, 0, offsetof(struct action_details, data));
+            details.data[0] = '\0';
+            details.implicit_any = IMPLICIT_AUTHENTICATION_REQUIRED;
+            details.implicit_inactive = IMPLICIT_AUTHENTICATION_REQUIRED;
+            details.implicit_active = IMPLICIT_AUTHENTICATION_REQUIRED;
+        }
+
+        r = sd_bus_message_append(reply, "ssssssuuu", id,
+                details.data + details.description, details.data + details.message,
+                details.data + details.vendor, details.data + details.vendor_url,
+                details.data + details.icon_name, details.implicit_any,
+                details.implicit_inactive, details.implicit_active);
         if (r < 0)
             goto end;
 
@@ -601,6 +1017,18 @@ static int method_enumerate_actions(sd_bus_message *m, void *userdata, sd_bus_er
         if (r < 0)
             goto end;
 
+        annotation = details.data + details.annotations;
+        for (j = 0; j < details.n_annotations; j++) {
+            const char *key = annotation;
+            const char *value = key + strlen(key) + 1;
+
+            r = sd_bus_message_append(reply, "{ss}", key, value);
+            if (r < 0)
+                goto end;
+
+            annotation = value + strlen(value) + 1;
+        }
+
         /* array */
         r = sd_bus_message_close_container(reply);
         if (r < 0)
@@ -610,8 +1038,6 @@ static int method_enumerate_actions(sd_bus_message *m, void *userdata, sd_bus_er
         r = sd_bus_message_close_container(reply);
         if (r < 0)
             goto end;
-
-        line++;
     }
 
     /* array */
@@ -626,178 +1052,1994 @@ end:
     return r;
 }
 
-static int property_backend_name(sd_bus *bus, const char *path,
-        const char *interface, const char *property, sd_bus_message *reply,
-        void *userdata, sd_bus_error *error)
-{
-    return sd_bus_message_append(reply, "s", "groupcheck");
-}
-
-static int property_backend_version(sd_bus *bus, const char *path,
-        const char *interface, const char *property, sd_bus_message *reply,
-        void *userdata, sd_bus_error *error)
+static int method_list_authorized_actions(sd_bus_message *m, void *userdata,
+        sd_bus_error *ret_error)
 {
-    return sd_bus_message_append(reply, "s", "0.1");
-}
+    struct context *ctx = userdata;
+    struct subject subject = { 0 };
+    sd_bus_message *reply = NULL;
+    const uint32_t *allowed;
+    uint32_t n_actions, a;
+    uint64_t start;
+    int r;
 
-static int property_backend_features(sd_bus *bus, const char *path,
-        const char *interface, const char *property, sd_bus_message *reply,
-        void *userdata, sd_bus_error *error)
-{
-    /* we don't support temprorary authorizations */
-    return sd_bus_message_append(reply, "u", 0);
-}
+    if (ctx->load_state != LOAD_DONE)
+        return queue_request(ctx, m, method_list_authorized_actions);
 
-static const sd_bus_vtable polkit_vtable[] = {
-    SD_BUS_VTABLE_START(0),
-    SD_BUS_METHOD("CheckAuthorization", "(sa{sv})sa{ss}us", "(bba{ss})", method_check_authorization, SD_BUS_VTABLE_UNPRIVILEGED),
-    SD_BUS_METHOD("CancelCheckAuthorization", "s", "", method_cancel_check_authorization, SD_BUS_VTABLE_UNPRIVILEGED),
-    SD_BUS_METHOD("EnumerateActions", "s", "a(ssssssuuua{ss})", method_enumerate_actions, SD_BUS_VTABLE_UNPRIVILEGED),
-    SD_BUS_PROPERTY("BackendName", "s", property_backend_name, 0, SD_BUS_VTABLE_PROPERTY_CONST),
-    SD_BUS_PROPERTY("BackendVersion", "s", property_backend_version, 0, SD_BUS_VTABLE_PROPERTY_CONST),
-    SD_BUS_PROPERTY("BackendFeatures", "u", property_backend_features, 0, SD_BUS_VTABLE_PROPERTY_CONST),
-    SD_BUS_VTABLE_END
-};
+    start = cache_now();
 
-static int parse_line(struct line_data *data)
+    r = parse_subject(m, &subject);
+    if (r < 0) {
+        fprintf(stderr, "Failed to parse subject\n");
+        return r;
+    }
+
+    ctx->stats.list_requests++;
+
+    r = engine_list(&ctx->engine, &subject, &allowed);
+    if (r < 0)
+        return r;
+
+    n_actions = policy_n_actions(ctx->engine.policy);
+
+    r = sd_bus_message_new_method_return(m, &reply);
+    if (r < 0)
+        goto end;
+
+    r = sd_bus_message_open_container(reply, SD_BUS_TYPE_ARRAY, "s");
+    if (r < 0)
+        goto end;
+
+    for (a = 0; a < n_actions; a++) {
+        if (!(allowed[a / 32] & (1U << (a % 32))))
+            continue;
+
+        r = sd_bus_message_append(reply, "s", policy_action_id(ctx->engine.policy, a));
+        if (r < 0)
+            goto end;
+    }
+
+    /* array */
+    r = sd_bus_message_close_container(reply);
+    if (r < 0)
+        goto end;
+
+    r = sd_bus_send(NULL, reply, NULL);
+
+    track_request(ctx, m, NULL, start);
+
+end:
+    sd_bus_message_unref(reply);
+    return r;
+}
+
+static int property_backend_name(sd_bus *bus, const char *path,
+        const char *interface, const char *property, sd_bus_message *reply,
+        void *userdata, sd_bus_error *error)
+{
+    return sd_bus_message_append(reply, "s", "groupcheck");
+}
+
+static int property_backend_version(sd_bus *bus, const char *path,
+        const char *interface, const char *property, sd_bus_message *reply,
+        void *userdata, sd_bus_error *error)
+{
+    return sd_bus_message_append(reply, "s", "0.1");
+}
+
+static int property_backend_features(sd_bus *bus, const char *path,
+        const char *interface, const char *property, sd_bus_message *reply,
+        void *userdata, sd_bus_error *error)
+{
+    /* we don't support temprorary authorizations */
+    return sd_bus_message_append(reply, "u", 0);
+}
+
+static int append_statistic(sd_bus_message *reply, const char *prefix,
+        const char *name, uint64_t value)
+{
+    char key[2*MAX_NAME_SIZE];
+    int r;
+
+    if (prefix) {
+        r = snprintf(key, sizeof(key), "%s.%s", prefix, name);
+        if (r < 0 || r >= (int) sizeof(key)) {
+            /* leave out counters with unreasonably long names */
+            return 0;
+        }
+        name = key;
+    }
+
+    return sd_bus_message_append(reply, "{st}", name, value);
+}
+
+static size_t resident_bytes(void)
+{
+    char buf[64];
+    unsigned long size, resident;
+    ssize_t len;
+    int fd;
+
+    fd = open("/proc/self/statm", O_RDONLY|O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+
+    len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0)
+        return 0;
+
+    buf[len] = '\0';
+    if (sscanf(buf, "%lu %lu", &size, &resident) != 2)
+        return 0;
+
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static int append_footprint(sd_bus_message *reply, struct context *ctx)
+{
+    struct engine_footprint fp;
+    struct cache_budget_stats bs;
+    struct pending_request *p;
+    size_t index_bytes = 0, pending_bytes = sizeof(ctx->pending_pool);
+    size_t actions_bytes = 0, heavy_bytes = 0;
+    int r, i;
+
+    /* What each part of groupcheck holds, to keep the footprint in check.
+     * The credential caches are under cache.* too. */
+
+    engine_get_footprint(&ctx->engine, &fp);
+    cache_budget_get_stats(ctx->budget, &bs);
+
+    for (i = 0; i < N_CACHES; i++) {
+        struct cache_stats cs;
+
+        cache_get_stats(ctx->engine.caches[i], &cs);
+        index_bytes += cs.index_bytes;
+    }
+
+    if (ctx->action_index) {
+        struct cache_stats cs;
+
+        cache_get_stats(action_index_cache(ctx->action_index), &cs);
+        index_bytes += cs.index_bytes;
+        actions_bytes = action_index_bytes(ctx->action_index);
+    }
+
+    for (i = 0; i < N_HEAVY; i++)
+        heavy_bytes += heavy_hitters_bytes(ctx->heavy[i]);
+
+    for (p = ctx->pending_head; p; p = p->next) {
+        if (p < ctx->pending_pool || p >= ctx->pending_pool + PENDING_POOL_SIZE)
+            pending_bytes += sizeof(struct pending_request);
+    }
+
+    r = append_statistic(reply, "memory", "resident-bytes", resident_bytes());
+    if (r < 0)
+        return r;
+
+    r = append_statistic(reply, "memory", "policy-bytes", fp.policy_bytes);
+    if (r < 0)
+        return r;
+
+    r = append_statistic(reply, "memory", "strings-bytes", fp.strings_bytes);
+    if (r < 0)
+        return r;
+
+    r = append_statistic(reply, "memory", "policy-state-bytes", fp.state_bytes);
+    if (r < 0)
+        return r;
+
+    r = append_statistic(reply, "memory", "gid-index-bytes", fp.gid_index_bytes);
+    if (r < 0)
+        return r;
+
+    r = append_statistic(reply, "memory", "scratch-bytes", fp.scratch_bytes);
+    if (r < 0)
+        return r;
+
+    r = append_statistic(reply, "memory", "cache-slab-bytes", bs.slab_bytes);
+    if (r < 0)
+        return r;
+
+    r = append_statistic(reply, "memory", "cache-index-bytes", index_bytes);
+    if (r < 0)
+        return r;
+
+    r = append_statistic(reply, "memory", "action-index-bytes", actions_bytes);
+    if (r < 0)
+        return r;
+
+    r = append_statistic(reply, "memory", "heavy-hitters-bytes", heavy_bytes);
+    if (r < 0)
+        return r;
+
+    return append_statistic(reply, "memory", "pending-bytes", pending_bytes);
+}
+
+static int append_cache_statistics(sd_bus_message *reply, struct cache *c)
+{
+    struct cache_stats cs;
+    char prefix[MAX_NAME_SIZE];
+    int r;
+
+    cache_get_stats(c, &cs);
+    snprintf(prefix, sizeof(prefix), "cache.%s", cache_name(c));
+
+    r = append_statistic(reply, prefix, "entries", cs.entries);
+    if (r < 0)
+        return r;
+
+    r = append_statistic(reply, prefix, "bytes", cs.bytes);
+    if (r < 0)
+        return r;
+
+    r = append_statistic(reply, prefix, "index-bytes", cs.index_bytes);
+    if (r < 0)
+        return r;
+
+    r = append_statistic(reply, prefix, "hits", cs.hits);
+    if (r < 0)
+        return r;
+
+    r = append_statistic(reply, prefix, "misses", cs.misses);
+    if (r < 0)
+        return r;
+
+    return append_statistic(reply, prefix, "evictions", cs.evictions);
+}
+
+static const sd_bus_vtable polkit_vtable[] = {
+    SD_BUS_VTABLE_START(0),
+    SD_BUS_METHOD("CheckAuthorization", "(sa{sv})sa{ss}us", "(bba{ss})", method_check_authorization, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("CancelCheckAuthorization", "s", "", method_cancel_check_authorization, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_METHOD("EnumerateActions", "s", "a(ssssssuuua{ss})", method_enumerate_actions, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_PROPERTY("BackendName", "s", property_backend_name, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+    SD_BUS_PROPERTY("BackendVersion", "s", property_backend_version, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+    SD_BUS_PROPERTY("BackendFeatures", "u", property_backend_features, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+    SD_BUS_SIGNAL("Changed", "", 0),
+    SD_BUS_VTABLE_END
+};
+
+static const sd_bus_vtable authority_vtable[] = {
+    SD_BUS_VTABLE_START(0),
+    SD_BUS_METHOD("ListAuthorizedActions", "(sa{sv})", "as", method_list_authorized_actions, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_VTABLE_END
+};
+
+static int on_message(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    struct context *ctx = userdata;
+
+    if (sd_bus_message_is_method_call(m, NULL, NULL) > 0)
+        sd_event_now(sd_bus_get_event(sd_bus_message_get_bus(m)),
+                CLOCK_MONOTONIC, &ctx->last_activity);
+
+    /* let the message through to the handlers */
+    return 0;
+}
+
+static void reload_action_index(struct context *ctx)
+{
+    struct action_index *ai;
+
+    /* services may have been installed or removed */
+    ai = action_index_new(POLKIT_ACTIONS_DIR, ctx->budget);
+    if (!ai) {
+        fprintf(stderr, "Error indexing polkit actions, keeping the old index.\n");
+        return;
+    }
+
+    action_index_free(ctx->action_index);
+    ctx->action_index = ai;
+}
+
+/* Peer-to-peer connections. Clients may also connect to a socket of
+ * groupcheck's own and talk the D-Bus protocol without the bus daemon. The
+ * main thread accepts the connections and hands them to the worker threads
+ * in turn, so that only one thread wakes up for each. Every worker runs an
+ * event loop and keeps the connections it got. The workers share the
+ * compiled policy of the main thread, but have their own resolved groups,
+ * caches, scratch space and counters, so that requests don't take locks.
+ *
+ * Policy reloads and invalidations are still handled by the main thread. It
+ * parks the workers, updates their state and then lets them continue. Bus
+ * names that are gone are passed on without parking anybody. */
+
+/* bus names passed on to the workers before they have to catch up */
+#define GONE_NAMES_SIZE 64
+/* accepted connections that a worker hasn't taken yet */
+#define NEW_PEERS_SIZE 32
+
+struct worker;
+
+struct peer {
+    struct peer *next;
+    struct peer *prev;
+    sd_bus *bus;
+    struct worker *worker;
+};
+
+struct worker {
+    struct workers *workers;
+    /* what the handlers of this thread see as the daemon state */
+    struct context ctx;
+    pthread_t thread;
+    bool started;
+    /* running is changed under the lock of the workers */
+    bool running;
+    /* the worker couldn't follow a policy change and is stopping */
+    bool failed;
+    sd_event *event;
+    int control_fd;
+    uint64_t changed_seq;
+    /* has_bus is set under the lock, once there is a bus connection */
+    bool has_bus;
+    uint64_t gone_seq;
+    /* connections from the main thread, under the lock */
+    int new_fds[NEW_PEERS_SIZE];
+    int n_new_fds;
+    struct peer *peers;
+    uint64_t n_peers;
+    uint64_t accepted;
+};
+
+struct workers {
+    const char *path;
+    mode_t mode;
+    int listen_fd;
+    struct stat listen_stat;
+    sd_event_source *listen_source;
+    int next_worker;
+    sd_id128_t server_id;
+    size_t budget_bytes;
+    int n_workers;
+    struct worker *workers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int n_running;
+    int n_parked;
+    bool pause;
+    bool stop;
+    /* the workers send Changed to their peers when this is bumped */
+    uint64_t changed_seq;
+    /* the unique bus names that went away last, for the workers that have
+     * a bus connection */
+    char gone_names[GONE_NAMES_SIZE][MAX_NAME_SIZE];
+    uint64_t gone_seq;
+};
+
+static void free_peer(struct peer *p)
+{
+    struct worker *w = p->worker;
+
+    if (p->prev)
+        p->prev->next = p->next;
+    else
+        w->peers = p->next;
+    if (p->next)
+        p->next->prev = p->prev;
+
+    w->n_peers--;
+
+    sd_bus_close(p->bus);
+    sd_bus_unref(p->bus);
+    free(p);
+}
+
+static int on_peer_disconnected(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    /* sd-bus holds a reference to the connection while dispatching */
+    free_peer(userdata);
+
+    return 0;
+}
+
+static int add_peer(struct worker *w, int fd)
+{
+    struct peer *p;
+    struct ucred ucred;
+    socklen_t len = sizeof(ucred);
+    char description[32];
+    int r;
+
+    p = calloc(1, sizeof(struct peer));
+    if (!p) {
+        close(fd);
+        return -ENOMEM;
+    }
+
+    p->worker = w;
+
+    r = sd_bus_new(&p->bus);
+    if (r < 0) {
+        close(fd);
+        goto fail;
+    }
+
+    /* the connection owns the socket from here on */
+    r = sd_bus_set_fd(p->bus, fd, fd);
+    if (r < 0) {
+        close(fd);
+        goto fail;
+    }
+
+    r = sd_bus_set_server(p->bus, 1, w->workers->server_id);
+    if (r < 0)
+        goto fail;
+
+    /* names the peer in the statistics, in place of a bus name */
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &ucred, &len) == 0) {
+        snprintf(description, sizeof(description), "pid:%d", (int) ucred.pid);
+        sd_bus_set_description(p->bus, description);
+    }
+
+    r = sd_bus_add_object_vtable(p->bus, NULL, AUTHORITY_PATH,
+            AUTHORITY_INTERFACE, polkit_vtable, &w->ctx);
+    if (r < 0)
+        goto fail;
+
+    r = sd_bus_add_object_vtable(p->bus, NULL, AUTHORITY_PATH,
+            "org.groupcheck.Authority1", authority_vtable, &w->ctx);
+    if (r < 0)
+        goto fail;
+
+    r = sd_bus_add_match(p->bus, NULL, PEER_DISCONNECTED_MATCH,
+            on_peer_disconnected, p);
+    if (r < 0)
+        goto fail;
+
+    if (w->ctx.idle_timeout > 0) {
+        r = sd_bus_add_filter(p->bus, NULL, on_message, &w->ctx);
+        if (r < 0)
+            goto fail;
+    }
+
+    r = sd_bus_attach_event(p->bus, w->event, 0);
+    if (r < 0)
+        goto fail;
+
+    r = sd_bus_start(p->bus);
+    if (r < 0)
+        goto fail;
+
+    p->next = w->peers;
+    if (w->peers)
+        w->peers->prev = p;
+    w->peers = p;
+
+    w->n_peers++;
+    w->accepted++;
+
+    return 0;
+
+fail:
+    sd_bus_unref(p->bus);
+    free(p);
+    return r;
+}
+
+/* in the main thread */
+static int on_peer_connect(sd_event_source *s, int fd, uint32_t revents, void *userdata)
+{
+    struct workers *ws = userdata;
+    struct worker *w;
+    uint64_t one = 1;
+    int peer_fd, i;
+
+    peer_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (peer_fd < 0) {
+        if (errno != EAGAIN && errno != EINTR && errno != ECONNABORTED)
+            fprintf(stderr, "Error accepting connection: %s\n", strerror(errno));
+        return 0;
+    }
+
+    pthread_mutex_lock(&ws->lock);
+
+    /* the next worker that can take it */
+    for (i = 0; i < ws->n_workers && peer_fd >= 0; i++) {
+        w = &ws->workers[ws->next_worker];
+        ws->next_worker = (ws->next_worker + 1) % ws->n_workers;
+
+        if (!w->running || w->failed || w->n_new_fds >= NEW_PEERS_SIZE)
+            continue;
+
+        w->new_fds[w->n_new_fds++] = peer_fd;
+        peer_fd = -1;
+
+        if (write(w->control_fd, &one, sizeof(one)) < 0)
+            fprintf(stderr, "Error waking up worker: %s\n", strerror(errno));
+    }
+
+    pthread_mutex_unlock(&ws->lock);
+
+    if (peer_fd >= 0) {
+        fprintf(stderr, "No worker can take the connection, closing it.\n");
+        close(peer_fd);
+    }
+
+    return 0;
+}
+
+/* the connections handed to the worker, from its own thread */
+static void add_new_peers(struct worker *w, const int *fds, int n_fds, bool stop)
+{
+    int i, r;
+
+    for (i = 0; i < n_fds; i++) {
+        if (stop) {
+            close(fds[i]);
+            continue;
+        }
+
+        r = add_peer(w, fds[i]);
+        if (r < 0)
+            fprintf(stderr, "Error setting up connection: %s\n", strerror(-r));
+    }
+}
+
+static void emit_peer_changed(struct worker *w)
+{
+    struct peer *p;
+    int r;
+
+    for (p = w->peers; p; p = p->next) {
+        r = sd_bus_emit_signal(p->bus, AUTHORITY_PATH, AUTHORITY_INTERFACE,
+                "Changed", NULL);
+        if (r < 0)
+            fprintf(stderr, "Error emitting Changed signal: %s\n", strerror(-r));
+    }
+}
+
+static int on_worker_control(sd_event_source *s, int fd, uint32_t revents, void *userdata)
+{
+    struct worker *w = userdata;
+    struct workers *ws = w->workers;
+    int fds[NEW_PEERS_SIZE];
+    int n_fds;
+    uint64_t value;
+    bool changed, stop;
+
+    if (read(fd, &value, sizeof(value)) < 0)
+        return 0;
+
+    pthread_mutex_lock(&ws->lock);
+
+    if (ws->pause) {
+        /* the main thread may change the state of this worker now */
+        ws->n_parked++;
+        pthread_cond_broadcast(&ws->cond);
+
+        while (ws->pause)
+            pthread_cond_wait(&ws->cond, &ws->lock);
+
+        ws->n_parked--;
+        pthread_cond_broadcast(&ws->cond);
+    }
+
+    changed = w->changed_seq != ws->changed_seq;
+    w->changed_seq = ws->changed_seq;
+    stop = ws->stop || w->failed;
+
+    /* A worker that has missed names can't tell which ones are gone. */
+    if (w->has_bus) {
+        if (ws->gone_seq - w->gone_seq > GONE_NAMES_SIZE)
+            engine_bus_names_changed(&w->ctx.engine);
+        else {
+            for (; w->gone_seq != ws->gone_seq; w->gone_seq++)
+                engine_bus_name_gone(&w->ctx.engine,
+                        ws->gone_names[w->gone_seq % GONE_NAMES_SIZE]);
+        }
+        w->gone_seq = ws->gone_seq;
+    }
+
+    n_fds = w->n_new_fds;
+    memcpy(fds, w->new_fds, n_fds * sizeof(int));
+    w->n_new_fds = 0;
+
+    pthread_mutex_unlock(&ws->lock);
+
+    add_new_peers(w, fds, n_fds, stop);
+
+    if (changed)
+        emit_peer_changed(w);
+
+    if (stop)
+        return sd_event_exit(w->event, 0);
+
+    return 0;
+}
+
+/* Bus name subjects are looked up on a bus connection of the worker, which
+ * is opened for the first one. The main thread tells the worker about the
+ * names that are gone, so the connection needs no match of its own. */
+static int worker_open_bus(struct worker *w)
+{
+    struct workers *ws = w->workers;
+    sd_bus *bus = NULL;
+    int r;
+
+    r = sd_bus_open_system(&bus);
+    if (r < 0)
+        goto fail;
+
+    r = sd_bus_attach_event(bus, w->event, 0);
+    if (r < 0)
+        goto fail;
+
+    /* nothing about a name can be cached before this */
+    pthread_mutex_lock(&ws->lock);
+    w->has_bus = true;
+    w->gone_seq = ws->gone_seq;
+    pthread_mutex_unlock(&ws->lock);
+
+    w->ctx.bus = bus;
+
+    return 0;
+
+fail:
+    fprintf(stderr, "Worker has no bus connection: %s\n", strerror(-r));
+    sd_bus_unref(bus);
+    return r;
+}
+
+static void *worker_thread(void *userdata)
+{
+    struct worker *w = userdata;
+    struct workers *ws = w->workers;
+    int r;
+
+    r = sd_event_loop(w->event);
+    if (r < 0)
+        fprintf(stderr, "Worker exited from event loop with error: %s\n", strerror(-r));
+
+    pthread_mutex_lock(&ws->lock);
+    w->running = false;
+    ws->n_running--;
+    pthread_cond_broadcast(&ws->cond);
+    pthread_mutex_unlock(&ws->lock);
+
+    return NULL;
+}
+
+/* Wait until every running worker is parked. The main thread may then use
+ * the state of the workers until it calls resume_workers(). */
+static void pause_workers(struct workers *ws)
+{
+    uint64_t one = 1;
+    int i;
+
+    pthread_mutex_lock(&ws->lock);
+
+    ws->pause = true;
+
+    for (i = 0; i < ws->n_workers; i++) {
+        if (ws->workers[i].running &&
+                write(ws->workers[i].control_fd, &one, sizeof(one)) < 0)
+            fprintf(stderr, "Error waking up worker: %s\n", strerror(errno));
+    }
+
+    while (ws->n_parked < ws->n_running)
+        pthread_cond_wait(&ws->cond, &ws->lock);
+
+    pthread_mutex_unlock(&ws->lock);
+}
+
+static void resume_workers(struct workers *ws, bool changed)
+{
+    pthread_mutex_lock(&ws->lock);
+
+    ws->pause = false;
+    if (changed)
+        ws->changed_seq++;
+    pthread_cond_broadcast(&ws->cond);
+
+    /* all of them must be out before they can be parked again */
+    while (ws->n_parked > 0)
+        pthread_cond_wait(&ws->cond, &ws->lock);
+
+    pthread_mutex_unlock(&ws->lock);
+}
+
+/* a worker that can be touched while the workers are parked */
+static struct worker *parked_worker(struct workers *ws, int i)
+{
+    struct worker *w = &ws->workers[i];
+
+    return w->running && !w->failed ? w : NULL;
+}
+
+/* Add the counters of the workers to those of the main thread. The workers
+ * must be parked or stopped. */
+static void collect_worker_counters(struct context *ctx)
+{
+    struct workers *ws = ctx->workers;
+    int i, j;
+
+    for (i = 0; i < ws->n_workers; i++) {
+        struct worker *w = &ws->workers[i];
+
+        if (!w->started)
+            continue;
+
+        engine_merge_counters(&ctx->engine, &w->ctx.engine);
+
+        ctx->stats.requests += w->ctx.stats.requests;
+        ctx->stats.allowed += w->ctx.stats.allowed;
+        ctx->stats.denied += w->ctx.stats.denied;
+        ctx->stats.list_requests += w->ctx.stats.list_requests;
+        memset(&w->ctx.stats, 0, sizeof(struct statistics));
+
+        for (j = 0; j < N_HEAVY; j++) {
+            if (w->ctx.heavy[j])
+                heavy_hitters_merge(ctx->heavy[j], w->ctx.heavy[j]);
+        }
+    }
+}
+
+/* The workers use the action index of the main thread, with caches of their
+ * own, so that the directory is read once. */
+static int share_action_index(struct context *ctx, struct worker *w)
+{
+    struct action_index *ai;
+
+    ai = action_index_share(ctx->action_index, w->ctx.budget);
+    if (!ai)
+        return -ENOMEM;
+
+    action_index_free(w->ctx.action_index);
+    w->ctx.action_index = ai;
+
+    return 0;
+}
+
+static int share_policy(struct context *ctx, struct worker *w)
+{
+    int r;
+
+    r = engine_share_policy(&w->ctx.engine, &ctx->engine);
+    if (r < 0)
+        return r;
+
+    engine_prepare(&w->ctx.engine);
+    w->ctx.generation = ctx->generation;
+    w->ctx.group_generation = ctx->group_generation;
+
+    return 0;
+}
+
+/* After a reload in the main thread, while the workers are parked. The old
+ * policy is gone already, so a worker that can't switch has to stop. */
+static void workers_reloaded(struct context *ctx, bool policy_changed)
+{
+    struct workers *ws = ctx->workers;
+    struct worker *w;
+    int i, r;
+
+    for (i = 0; i < ws->n_workers; i++) {
+        if (!(w = parked_worker(ws, i)))
+            continue;
+
+        if (share_action_index(ctx, w) < 0)
+            fprintf(stderr, "Error sharing polkit actions, keeping the old index.\n");
+
+        if (!policy_changed)
+            continue;
+
+        r = share_policy(ctx, w);
+        if (r < 0) {
+            fprintf(stderr, "Stopping worker, no memory for the policy: %s\n",
+                    strerror(-r));
+            w->ctx.engine.policy = NULL;
+            w->failed = true;
+        }
+    }
+
+    resume_workers(ws, policy_changed);
+}
+
+static void workers_groups_changed(struct context *ctx)
+{
+    struct workers *ws = ctx->workers;
+    struct worker *w;
+    int i;
+
+    pause_workers(ws);
+
+    for (i = 0; i < ws->n_workers; i++) {
+        if (!(w = parked_worker(ws, i)))
+            continue;
+
+        engine_groups_changed(&w->ctx.engine);
+        w->ctx.generation = ctx->generation;
+        w->ctx.group_generation = ctx->group_generation;
+    }
+
+    resume_workers(ws, true);
+}
+
+/* from the main thread, which gets the NameOwnerChanged signals */
+static void workers_bus_name_gone(struct workers *ws, const char *name)
+{
+    uint64_t one = 1;
+    int i;
+
+    /* longer names can't be in the caches */
+    if (strlen(name) >= MAX_NAME_SIZE)
+        return;
+
+    pthread_mutex_lock(&ws->lock);
+
+    strcpy(ws->gone_names[ws->gone_seq % GONE_NAMES_SIZE], name);
+    ws->gone_seq++;
+
+    for (i = 0; i < ws->n_workers; i++) {
+        if (ws->workers[i].running && ws->workers[i].has_bus &&
+                write(ws->workers[i].control_fd, &one, sizeof(one)) < 0)
+            fprintf(stderr, "Error waking up worker: %s\n", strerror(errno));
+    }
+
+    pthread_mutex_unlock(&ws->lock);
+}
+
+static int on_name_owner_changed(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    struct context *ctx = userdata;
+    const char *name, *old_owner, *new_owner;
+    int r;
+
+    r = sd_bus_message_read(m, "sss", &name, &old_owner, &new_owner);
+    if (r < 0)
+        return 0;
+
+    /* a unique name went away and will never come back */
+    if (name[0] == ':' && new_owner[0] == '\0') {
+        engine_bus_name_gone(&ctx->engine, name);
+
+        if (ctx->workers)
+            workers_bus_name_gone(ctx->workers, name);
+    }
+
+    return 0;
+}
+
+static void workers_sessions_changed(struct context *ctx)
+{
+    struct workers *ws = ctx->workers;
+    struct worker *w;
+    int i;
+
+    pause_workers(ws);
+
+    for (i = 0; i < ws->n_workers; i++) {
+        if ((w = parked_worker(ws, i)))
+            engine_sessions_changed(&w->ctx.engine);
+    }
+
+    resume_workers(ws, false);
+}
+
+/* the workers must be parked */
+static size_t shrink_worker_caches(struct workers *ws)
+{
+    struct cache_budget_stats bs;
+    struct worker *w;
+    size_t bytes = 0;
+    int i;
+
+    for (i = 0; i < ws->n_workers; i++) {
+        if (!(w = parked_worker(ws, i)))
+            continue;
+
+        cache_budget_get_stats(w->ctx.budget, &bs);
+        bytes += cache_budget_shrink(w->ctx.budget,
+                bs.max_bytes * CACHE_LOW_WATER_PERCENT / 100);
+    }
+
+    return bytes;
+}
+
+static uint64_t workers_last_activity(struct workers *ws, uint64_t last_activity)
+{
+    struct worker *w;
+    int i;
+
+    pause_workers(ws);
+
+    for (i = 0; i < ws->n_workers; i++) {
+        if ((w = parked_worker(ws, i)) && w->ctx.last_activity > last_activity)
+            last_activity = w->ctx.last_activity;
+    }
+
+    resume_workers(ws, false);
+
+    return last_activity;
+}
+
+static int append_worker_statistics(sd_bus_message *reply, struct workers *ws)
+{
+    struct cache_budget_stats bs;
+    uint64_t threads = 0, connections = 0, accepted = 0, cache_bytes = 0;
+    int i, r;
+
+    for (i = 0; i < ws->n_workers; i++) {
+        struct worker *w = &ws->workers[i];
+
+        if (!w->started)
+            continue;
+
+        cache_budget_get_stats(w->ctx.budget, &bs);
+
+        threads += w->running;
+        connections += w->n_peers;
+        accepted += w->accepted;
+        cache_bytes += bs.bytes;
+    }
+
+    r = append_statistic(reply, "p2p", "threads", threads);
+    if (r < 0)
+        return r;
+
+    r = append_statistic(reply, "p2p", "connections", connections);
+    if (r < 0)
+        return r;
+
+    r = append_statistic(reply, "p2p", "accepted", accepted);
+    if (r < 0)
+        return r;
+
+    return append_statistic(reply, "p2p", "cache-bytes", cache_bytes);
+}
+
+static int start_worker(struct context *ctx, struct worker *w)
+{
+    struct workers *ws = ctx->workers;
+    int r;
+
+    w->ctx.worker = w;
+    w->ctx.load_state = LOAD_DONE;
+    w->ctx.policy_file = ctx->policy_file;
+    w->ctx.idle_timeout = ctx->idle_timeout;
+    w->ctx.last_activity = ctx->last_activity;
+
+    w->ctx.budget = cache_budget_new(ws->budget_bytes);
+    if (!w->ctx.budget)
+        return -ENOMEM;
+
+    r = new_heavy_hitters(&w->ctx);
+    if (r < 0)
+        return r;
+
+    r = engine_init(&w->ctx.engine, &system_provider, &w->ctx, w->ctx.budget);
+    if (r < 0)
+        return r;
+
+    r = share_policy(ctx, w);
+    if (r < 0)
+        return r;
+
+    r = share_action_index(ctx, w);
+    if (r < 0)
+        return r;
+
+    r = sd_event_new(&w->event);
+    if (r < 0)
+        return r;
+
+    w->control_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (w->control_fd < 0)
+        return -errno;
+
+    r = sd_event_add_io(w->event, NULL, w->control_fd, EPOLLIN, on_worker_control, w);
+    if (r < 0)
+        return r;
+
+    w->running = true;
+    ws->n_running++;
+
+    r = pthread_create(&w->thread, NULL, worker_thread, w);
+    if (r != 0) {
+        w->running = false;
+        ws->n_running--;
+        return -r;
+    }
+
+    w->started = true;
+
+    return 0;
+}
+
+static int start_workers(struct context *ctx, sd_event *e)
+{
+    struct workers *ws = ctx->workers;
+    int i, r;
+
+    for (i = 0; i < ws->n_workers; i++) {
+        r = start_worker(ctx, &ws->workers[i]);
+        if (r < 0)
+            return r;
+    }
+
+    r = sd_event_add_io(e, &ws->listen_source, ws->listen_fd, EPOLLIN,
+            on_peer_connect, ws);
+    if (r < 0)
+        return r;
+
+    fprintf(stdout, "Serving %s with %d threads.\n", ws->path, ws->n_workers);
+
+    return 0;
+}
+
+static int open_listener(struct workers *ws)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int r;
+
+    if (strlen(ws->path) >= sizeof(addr.sun_path))
+        return -ENAMETOOLONG;
+
+    strcpy(addr.sun_path, ws->path);
+
+    ws->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (ws->listen_fd < 0)
+        return -errno;
+
+    /* a socket left behind by an earlier instance */
+    unlink(ws->path);
+
+    if (bind(ws->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+            chmod(ws->path, ws->mode) < 0 ||
+            stat(ws->path, &ws->listen_stat) < 0 ||
+            listen(ws->listen_fd, SOMAXCONN) < 0) {
+        r = -errno;
+        close(ws->listen_fd);
+        ws->listen_fd = -1;
+        return r;
+    }
+
+    return 0;
+}
+
+static int new_workers(struct context *ctx, const char *path, mode_t mode,
+        int n_workers, size_t cache_budget)
+{
+    struct workers *ws;
+    int i, r;
+
+    ws = calloc(1, sizeof(struct workers));
+    if (!ws)
+        return -ENOMEM;
+
+    ctx->workers = ws;
+
+    ws->path = path;
+    ws->mode = mode;
+    ws->listen_fd = -1;
+    /* the cache budget is divided between the workers */
+    ws->budget_bytes = cache_budget / n_workers;
+    pthread_mutex_init(&ws->lock, NULL);
+    pthread_cond_init(&ws->cond, NULL);
+
+    ws->workers = calloc(n_workers, sizeof(struct worker));
+    if (!ws->workers)
+        return -ENOMEM;
+
+    ws->n_workers = n_workers;
+
+    for (i = 0; i < n_workers; i++) {
+        ws->workers[i].workers = ws;
+        ws->workers[i].control_fd = -1;
+        ws->workers[i].ctx.pressure_fd = -1;
+        ws->workers[i].ctx.state_fd = -1;
+        ws->workers[i].ctx.loaded_fd = -1;
+    }
+
+    r = sd_id128_randomize(&ws->server_id);
+    if (r < 0)
+        return r;
+
+    return open_listener(ws);
+}
+
+/* Stop the workers and close their connections. Their counters are added to
+ * those of the main thread before they are freed. */
+static void free_workers(struct context *ctx)
+{
+    struct workers *ws = ctx->workers;
+    struct stat st;
+    uint64_t one = 1;
+    int i;
+
+    if (!ws)
+        return;
+
+    pthread_mutex_lock(&ws->lock);
+    ws->stop = true;
+    pthread_mutex_unlock(&ws->lock);
+
+    for (i = 0; i < ws->n_workers; i++) {
+        struct worker *w = &ws->workers[i];
+
+        if (!w->started)
+            continue;
+
+        if (write(w->control_fd, &one, sizeof(one)) < 0)
+            fprintf(stderr, "Error stopping worker: %s\n", strerror(errno));
+
+        pthread_join(w->thread, NULL);
+    }
+
+    if (ctx->load_state == LOAD_DONE)
+        collect_worker_counters(ctx);
+
+    for (i = 0; i < ws->n_workers; i++) {
+        struct worker *w = &ws->workers[i];
+
+        while (w->peers)
+            free_peer(w->peers);
+
+        /* handed over, but not taken before the worker stopped */
+        while (w->n_new_fds > 0)
+            close(w->new_fds[--w->n_new_fds]);
+
+        if (w->control_fd >= 0)
+            close(w->control_fd);
+
+        sd_bus_unref(w->ctx.bus);
+        sd_event_unref(w->event);
+        action_index_free(w->ctx.action_index);
+        engine_done(&w->ctx.engine);
+        cache_budget_free(w->ctx.budget);
+        free_heavy_hitters(&w->ctx);
+    }
+
+    sd_event_source_unref(ws->listen_source);
+
+    if (ws->listen_fd >= 0) {
+        close(ws->listen_fd);
+
+        /* unless a newer instance has already put its own socket there */
+        if (stat(ws->path, &st) == 0 && st.st_dev == ws->listen_stat.st_dev &&
+                st.st_ino == ws->listen_stat.st_ino)
+            unlink(ws->path);
+    }
+
+    pthread_mutex_destroy(&ws->lock);
+    pthread_cond_destroy(&ws->cond);
+    free(ws->workers);
+    free(ws);
+
+    ctx->workers = NULL;
+}
+
+static int append_heavy_hitters(sd_bus_message *reply, struct context *ctx)
+{
+    struct heavy_entry top[HEAVY_REPORT_SIZE];
+    char prefix[MAX_NAME_SIZE];
+    unsigned int n, j;
+    int r, i;
+
+    for (i = 0; i < N_HEAVY; i++) {
+        snprintf(prefix, sizeof(prefix), "top.%s", heavy_names[i]);
+
+        n = heavy_hitters_top(ctx->heavy[i], top, HEAVY_REPORT_SIZE);
+        for (j = 0; j < n; j++) {
+            r = append_statistic(reply, prefix, top[j].key, top[j].weight);
+            if (r < 0)
+                return r;
+        }
+    }
+
+    return 0;
+}
+
+static int method_get_statistics(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    int r, i;
+    sd_bus_message *reply = NULL;
+    struct context *ctx = userdata;
+    struct statistics *stats = &ctx->stats;
+    struct cache_budget_stats bs;
+#ifdef ALLOC_ACCOUNTING
+    struct alloc_stats as;
+#endif
+    size_t policy_size;
+    uint32_t a;
+
+    /* the counters of the workers are added to the totals */
+    if (ctx->workers) {
+        pause_workers(ctx->workers);
+        if (ctx->load_state == LOAD_DONE)
+            collect_worker_counters(ctx);
+    }
+
+    r = sd_bus_message_new_method_return(m, &reply);
+    if (r < 0)
+        goto end;
+
+    r = sd_bus_message_open_container(reply, SD_BUS_TYPE_ARRAY, "{st}");
+    if (r < 0)
+        goto end;
+
+    r = append_statistic(reply, NULL, "requests", stats->requests);
+    if (r < 0)
+        goto end;
+
+    r = append_statistic(reply, "requests", "allowed", stats->allowed);
+    if (r < 0)
+        goto end;
+
+    r = append_statistic(reply, "requests", "denied", stats->denied);
+    if (r < 0)
+        goto end;
+
+    r = append_statistic(reply, "requests", "short-circuited", ctx->engine.stats.short_circuited);
+    if (r < 0)
+        goto end;
+
+    r = append_statistic(reply, "requests", "list", stats->list_requests);
+    if (r < 0)
+        goto end;
+
+    r = append_statistic(reply, "signals", "changed", stats->changed_signals);
+    if (r < 0)
+        goto end;
+
+    r = append_statistic(reply, "memory", "pressure-events", stats->pressure_events);
+    if (r < 0)
+        goto end;
+
+    r = append_statistic(reply, "memory", "cache-bytes-reclaimed", stats->cache_bytes_reclaimed);
+    if (r < 0)
+        goto end;
+
+    r = append_statistic(reply, "memory", "heap-bytes-trimmed", stats->heap_bytes_trimmed);
+    if (r < 0)
+        goto end;
+
+    r = append_statistic(reply, "requests", "queued", stats->queued_requests);
+    if (r < 0)
+        goto end;
+
+    if (ctx->load_state != LOAD_DONE)
+        goto caches;
+
+    policy_blob(ctx->engine.policy, &policy_size);
+
+    r = append_statistic(reply, "policy", "bytes", policy_size);
+    if (r < 0)
+        goto end;
+
+    r = append_statistic(reply, "policy", "actions", policy_n_actions(ctx->engine.policy));
+    if (r < 0)
+        goto end;
+
+    r = append_statistic(reply, "policy", "groups", policy_n_groups(ctx->engine.policy));
+    if (r < 0)
+        goto end;
+
+    r = append_statistic(reply, "policy", "warm-start", ctx->warm_start);
+    if (r < 0)
+        goto end;
+
+    r = append_statistic(reply, "policy", "reloads", stats->policy_reloads);
+    if (r < 0)
+        goto end;
+
+    r = append_statistic(reply, "groups", "generation", ctx->group_generation);
+    if (r < 0)
+        goto end;
+
+    r = append_statistic(reply, "policy", "generation", ctx->generation);
+    if (r < 0)
+        goto end;
+
+    /* requests per action, these survive restarts */
+    for (a = 0; a < policy_n_actions(ctx->engine.policy); a++) {
+        if (ctx->engine.action_requests[a] == 0)
+            continue;
+
+        r = append_statistic(reply, "action", policy_action_id(ctx->engine.policy, a),
+                ctx->engine.action_requests[a]);
+        if (r < 0)
+            goto end;
+    }
+
+    /* the loader thread builds the engine state and the action index */
+    r = append_footprint(reply, ctx);
+    if (r < 0)
+        goto end;
+
+    if (ctx->action_index) {
+        r = append_cache_statistics(reply, action_index_cache(ctx->action_index));
+        if (r < 0)
+            goto end;
+    }
+
+caches:
+    cache_budget_get_stats(ctx->budget, &bs);
+
+    r = append_statistic(reply, "cache", "budget-bytes", bs.max_bytes);
+    if (r < 0)
+        goto end;
+
+    r = append_statistic(reply, "cache", "bytes", bs.bytes);
+    if (r < 0)
+        goto end;
+
+    r = append_statistic(reply, "cache", "evictions", bs.evictions);
+    if (r < 0)
+        goto end;
+
+#ifdef ALLOC_ACCOUNTING
+    alloc_get_stats(&as);
+
+    r = append_statistic(reply, "memory", "allocations", as.allocations);
+    if (r < 0)
+        goto end;
+
+    r = append_statistic(reply, "memory", "frees", as.frees);
+    if (r < 0)
+        goto end;
+#endif
+
+    for (i = 0; i < N_CACHES; i++) {
+        r = append_cache_statistics(reply, ctx->engine.caches[i]);
+        if (r < 0)
+            goto end;
+    }
+
+    if (ctx->workers) {
+        r = append_worker_statistics(reply, ctx->workers);
+        if (r < 0)
+            goto end;
+    }
+
+    r = append_heavy_hitters(reply, ctx);
+    if (r < 0)
+        goto end;
+
+    /* array */
+    r = sd_bus_message_close_container(reply);
+    if (r < 0)
+        goto end;
+
+    r = sd_bus_send(NULL, reply, NULL);
+
+end:
+    if (ctx->workers)
+        resume_workers(ctx->workers, false);
+
+    sd_bus_message_unref(reply);
+    return r;
+}
+
+static const sd_bus_vtable statistics_vtable[] = {
+    SD_BUS_VTABLE_START(0),
+    SD_BUS_METHOD("GetStatistics", "", "a{st}", method_get_statistics, SD_BUS_VTABLE_UNPRIVILEGED),
+    SD_BUS_VTABLE_END
+};
+
+static const char *find_policy_file()
+{
+    struct stat s;
+    const char *dynamic_conf = "/etc/groupcheck.policy";
+    const char *default_conf = "/usr/share/defaults/etc/groupcheck.policy";
+
+    if (stat(dynamic_conf, &s) == 0)
+        return dynamic_conf;
+    else if (stat(default_conf, &s) == 0)
+        return default_conf;
+
+    return NULL;
+}
+
+static void reclaim_memory(struct context *ctx)
+{
+    struct cache_budget_stats bs;
+    size_t cache_bytes;
+    size_t before, after;
+
+    before = resident_bytes();
+
+    cache_budget_get_stats(ctx->budget, &bs);
+    cache_bytes = cache_budget_shrink(ctx->budget,
+            bs.max_bytes * CACHE_LOW_WATER_PERCENT / 100);
+
+    if (ctx->workers) {
+        pause_workers(ctx->workers);
+        cache_bytes += shrink_worker_caches(ctx->workers);
+        if (ctx->load_state == LOAD_DONE)
+            collect_worker_counters(ctx);
+        resume_workers(ctx->workers, false);
+    }
+
+    /* return the freed cache entries and unused sd-bus buffers to the kernel */
+    malloc_trim(0);
+
+    after = resident_bytes();
+
+    ctx->stats.pressure_events++;
+    ctx->stats.cache_bytes_reclaimed += cache_bytes;
+    if (before > after)
+        ctx->stats.heap_bytes_trimmed += before - after;
+
+    fprintf(stdout, "Memory pressure: released %zu bytes of cache, resident size %zu -> %zu bytes\n",
+            cache_bytes, before, after);
+
+    /* who was keeping groupcheck busy when the system stalled */
+    report_heavy_hitters(ctx);
+}
+
+static int on_memory_pressure(sd_event_source *s, int fd, uint32_t revents, void *userdata)
+{
+    struct context *ctx = userdata;
+
+    if (revents & EPOLLERR) {
+        /* the trigger is gone, stop watching */
+        fprintf(stderr, "Memory pressure monitoring stopped.\n");
+        return sd_event_source_set_enabled(s, SD_EVENT_OFF);
+    }
+
+    if (revents & EPOLLPRI)
+        reclaim_memory(ctx);
+
+    return 0;
+}
+
+static int watch_memory_pressure(struct context *ctx, sd_event *e)
+{
+    int fd, r;
+    ssize_t len = strlen(PRESSURE_TRIGGER) + 1;
+
+    fd = open(PRESSURE_FILE, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+
+    if (write(fd, PRESSURE_TRIGGER, len) != len) {
+        r = -errno;
+        close(fd);
+        return r;
+    }
+
+    r = sd_event_add_io(e, NULL, fd, EPOLLPRI, on_memory_pressure, ctx);
+    if (r < 0) {
+        close(fd);
+        return r;
+    }
+
+    ctx->pressure_fd = fd;
+
+    return 0;
+}
+
+static void emit_changed(struct context *ctx)
+{
+    int r;
+
+    /* Tells clients to drop the authorizations they have cached. Sent only
+     * when decisions may really have changed, so that clients can cache
+     * for as long as possible. */
+
+    if (!ctx->bus)
+        return;
+
+    r = sd_bus_emit_signal(ctx->bus, AUTHORITY_PATH, AUTHORITY_INTERFACE,
+            "Changed", NULL);
+    if (r < 0) {
+        fprintf(stderr, "Error emitting Changed signal: %s\n", strerror(-r));
+        return;
+    }
+
+    ctx->stats.changed_signals++;
+}
+
+static bool update_group_generation(struct context *ctx)
+{
+    struct file_identity id;
+
+    snapshot_file_identity(GROUP_FILE, &id);
+
+    if (memcmp(&id, &ctx->group_file_id, sizeof(id)) == 0)
+        return false;
+
+    ctx->group_file_id = id;
+    ctx->group_generation++;
+
+    return true;
+}
+
+static int reload_policy(struct context *ctx)
+{
+    struct policy *policy;
+    struct file_identity id;
+    const void *old_blob, *new_blob;
+    size_t old_size, new_size;
+    int r;
+
+    snapshot_file_identity(ctx->policy_file, &id);
+
+    policy = policy_load(ctx->policy_file);
+    if (!policy)
+        return -EINVAL;
+
+    old_blob = policy_blob(ctx->engine.policy, &old_size);
+    new_blob = policy_blob(policy, &new_size);
+
+    /* comments and reordering don't matter, the compiled form does */
+    if (old_size == new_size && memcmp(old_blob, new_blob, old_size) == 0) {
+        ctx->policy_file_id = id;
+        policy_free(policy);
+        return 0;
+    }
+
+    r = engine_replace_policy(&ctx->engine, policy);
+    if (r < 0) {
+        policy_free(policy);
+        return r;
+    }
+
+    ctx->policy_file_id = id;
+
+    engine_prepare(&ctx->engine);
+    update_generation(ctx);
+
+    return 1;
+}
+
+static int on_reload_signal(sd_event_source *s, const struct signalfd_siginfo *si,
+        void *userdata)
+{
+    struct context *ctx = userdata;
+    int r;
+
+    if (ctx->load_state != LOAD_DONE) {
+        fprintf(stderr, "Policy is still loading, not reloading.\n");
+        return 0;
+    }
+
+    /* the request counters move over to the new policy with the main ones */
+    if (ctx->workers) {
+        pause_workers(ctx->workers);
+        collect_worker_counters(ctx);
+    }
+
+    reload_action_index(ctx);
+
+    r = reload_policy(ctx);
+
+    if (ctx->workers)
+        workers_reloaded(ctx, r > 0);
+
+    if (r < 0) {
+        fprintf(stderr, "Error reloading policy, keeping the old one: %s\n",
+                strerror(-r));
+        return 0;
+    }
+
+    if (r == 0) {
+        fprintf(stdout, "Policy is unchanged.\n");
+        return 0;
+    }
+
+    fprintf(stdout, "Reloaded policy.\n");
+    ctx->stats.policy_reloads++;
+    emit_changed(ctx);
+
+    return 0;
+}
+
+static int on_group_file_changed(sd_event_source *s, const struct inotify_event *event,
+        void *userdata)
+{
+    struct context *ctx = userdata;
+
+    if (event->len == 0 || strcmp(event->name, GROUP_FILE_NAME) != 0)
+        return 0;
+
+    /* one edit causes several events, only the first one counts */
+    if (!update_group_generation(ctx))
+        return 0;
+
+    /* the loader owns the groups until it is done */
+    if (ctx->load_state != LOAD_DONE) {
+        ctx->groups_changed = true;
+        return 0;
+    }
+
+    engine_groups_changed(&ctx->engine);
+
+    update_generation(ctx);
+    emit_changed(ctx);
+
+    if (ctx->workers)
+        workers_groups_changed(ctx);
+
+    return 0;
+}
+
+static int on_login_changed(sd_event_source *s, int fd, uint32_t revents, void *userdata)
 {
-    char *p;
-    bool has_equals = false;
-    bool group_begins = true;
+    struct context *ctx = userdata;
 
-    memset(data->groups, 0, MAX_GROUPS*sizeof(char *));
-    data->n_groups = 0;
+    sd_login_monitor_flush(ctx->login_monitor);
 
-    /* data->buf has already been initialized with the raw data */
+    /* sessions came or went */
+    engine_sessions_changed(&ctx->engine);
 
-    p = data->id = data->buf;
+    if (ctx->workers)
+        workers_sessions_changed(ctx);
 
-    while (*p && p != data->buf + sizeof(data->buf)) {
-        if (*p == '=') {
-            has_equals = true;
-            *p = '\0';
-            p++;
-            break;
-        }
-        p++;
+    return 0;
+}
+
+static int watch_sessions(struct context *ctx, sd_event *e)
+{
+    int r;
+
+    r = sd_login_monitor_new("session", &ctx->login_monitor);
+    if (r < 0)
+        return r;
+
+    return sd_event_add_io(e, NULL, sd_login_monitor_get_fd(ctx->login_monitor),
+            sd_login_monitor_get_events(ctx->login_monitor), on_login_changed, ctx);
+}
+
+static int on_exit_signal(sd_event_source *s, const struct signalfd_siginfo *si,
+        void *userdata)
+{
+    return sd_event_exit(sd_event_source_get_event(s), 0);
+}
+
+static int load_state(struct context *ctx)
+{
+    struct snapshot snapshot;
+    int r;
+
+    /* A snapshot from the previous instance lets us skip parsing the policy
+     * and, if the group database hasn't changed, the group lookups. */
+
+    r = -ENOENT;
+
+    if (ctx->state_fd >= 0) {
+        /* handed over by the previous instance through the fd store */
+        r = snapshot_load_fd(ctx->state_fd, ctx->policy_file, GROUP_FILE, &snapshot);
+        close(ctx->state_fd);
+        ctx->state_fd = -1;
     }
 
-    if (!has_equals) {
-        fprintf(stderr, "Error parsing configuration file.\n");
-        return -EINVAL;
+    if (r < 0)
+        r = snapshot_load(STATE_FILE, ctx->policy_file, GROUP_FILE, &snapshot);
+
+    if (r == 0) {
+        ctx->warm_start = true;
+        ctx->state_changed = !snapshot.groups;
+        fprintf(stdout, "Loaded policy snapshot%s.\n",
+                snapshot.groups ? "" : " (group database has changed)");
+
+        ctx->policy_file_id = snapshot.policy_file_id;
+
+        return engine_set_policy(&ctx->engine, snapshot.policy, snapshot.groups,
+                snapshot.action_requests);
     }
 
-    if (*p != '"') {
-        fprintf(stderr, "Error parsing configuration file.\n");
+    if (r != -ENOENT)
+        fprintf(stdout, "Not using policy snapshot: %s\n", strerror(-r));
+
+    snapshot_file_identity(ctx->policy_file, &ctx->policy_file_id);
+
+    snapshot.policy = policy_load(ctx->policy_file);
+    if (!snapshot.policy)
         return -EINVAL;
+
+    ctx->state_changed = true;
+
+    return engine_set_policy(&ctx->engine, snapshot.policy, NULL, NULL);
+}
+
+static void *loader_thread(void *userdata)
+{
+    struct context *ctx = userdata;
+    uint64_t one = 1;
+
+    ctx->load_result = load_state(ctx);
+
+    /* Resolve the groups of all actions here rather than on the first
+     * requests. With a warm snapshot this needs no group lookups. */
+    if (ctx->load_result == 0) {
+        engine_prepare(&ctx->engine);
+
+        /* Only where each action is defined is read now. The descriptions
+         * are parsed when they are asked for. */
+        ctx->action_index = action_index_new(POLKIT_ACTIONS_DIR, ctx->budget);
+        if (!ctx->action_index)
+            ctx->load_result = -ENOMEM;
     }
 
-    if (p != data->buf + sizeof(data->buf))
-        p++;
+    /* wake up the event loop */
+    if (write(ctx->loaded_fd, &one, sizeof(one)) < 0)
+        fprintf(stderr, "Error signaling policy load: %s\n", strerror(errno));
 
-    while (*p && p != data->buf + sizeof(data->buf)) {
-        if (group_begins) {
-            if (data->n_groups >= MAX_GROUPS) {
-                fprintf(stderr, "Error: too many groups defined.\n");
-                return -EINVAL;
-            }
-            data->groups[data->n_groups++] = p;
-            group_begins = false;
-            continue;
-        }
+    return NULL;
+}
+
+static void process_pending(struct context *ctx)
+{
+    struct pending_request *p;
+    int r;
+
+    while ((p = ctx->pending_head)) {
+        sd_bus_error error = SD_BUS_ERROR_NULL;
 
-        if (*p == ',') {
-            group_begins = true;
-            *p = '\0';
+        ctx->pending_head = p->next;
+        if (!ctx->pending_head)
+            ctx->pending_tail = NULL;
+
+        r = p->handler(p->m, ctx, &error);
+        if (r < 0)
+            sd_bus_reply_method_errno(p->m, r, &error);
+
+        sd_bus_error_free(&error);
+        sd_bus_message_unref(p->m);
+
+        if (p >= ctx->pending_pool && p < ctx->pending_pool + PENDING_POOL_SIZE) {
+            p->next = ctx->pending_free;
+            ctx->pending_free = p;
         }
-        else if (*p == '"') {
-            /* done parsing the line */
-            *p = '\0';
-            return 0;
+        else
+            free(p);
+    }
+}
+
+static int finish_loading(struct context *ctx)
+{
+    if (!ctx->loader_running)
+        return ctx->load_result;
+
+    pthread_join(ctx->loader, NULL);
+    ctx->loader_running = false;
+
+    if (ctx->load_result < 0) {
+        fprintf(stderr, "Error loading policy data.\n");
+        ctx->load_state = LOAD_FAILED;
+    }
+    else {
+        if (ctx->groups_changed)
+            engine_groups_changed(&ctx->engine);
+        update_generation(ctx);
+        ctx->load_state = LOAD_DONE;
+    }
+
+    /* answer the requests that came in while loading */
+    process_pending(ctx);
+
+    return ctx->load_result;
+}
+
+static int on_policy_loaded(sd_event_source *s, int fd, uint32_t revents, void *userdata)
+{
+    struct context *ctx = userdata;
+    uint64_t value;
+    int r;
+
+    if (read(fd, &value, sizeof(value)) < 0 && errno == EAGAIN)
+        return 0;
+
+    sd_event_source_set_enabled(s, SD_EVENT_OFF);
+
+    r = finish_loading(ctx);
+    if (r < 0)
+        return sd_event_exit(sd_event_source_get_event(s), r);
+
+    if (ctx->workers) {
+        r = start_workers(ctx, sd_event_source_get_event(s));
+        if (r < 0) {
+            fprintf(stderr, "Error starting workers: %s\n", strerror(-r));
+            return sd_event_exit(sd_event_source_get_event(s), r);
         }
-        p++;
     }
 
-    fprintf(stderr, "Error parsing configuration file.\n");
-    return -EINVAL;
+    /* The previous instance may have answered with another policy or
+     * other groups. A warm start with unchanged inputs changes nothing. */
+    if (ctx->state_changed || ctx->groups_changed)
+        emit_changed(ctx);
+
+    sd_notify(0, "READY=1\nSTATUS=Policy loaded.");
+
+    return 0;
 }
 
-static struct line_data * load_file(const char *filename)
+static int start_loading(struct context *ctx, sd_event *e)
 {
-    FILE *f;
-    char buf[LINE_BUF_SIZE];
-    int n_lines = 0;
-    int r, i;
-    struct line_data *data = NULL;
+    int r;
 
-    f = fopen(filename, "r");
+    ctx->loaded_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (ctx->loaded_fd < 0)
+        return -errno;
 
-    if (f == NULL)
-        return NULL;
+    r = sd_event_add_io(e, NULL, ctx->loaded_fd, EPOLLIN, on_policy_loaded, ctx);
+    if (r < 0)
+        return r;
 
-    /* The configuration file must be of following format. No whitespaces
-     * are allowed except for newlines. First part of the line is the action-id.
-     * It is followed by an equation mark and then the comma-separated list of
-     * groups inside double quotation marks. Comments are lines starting with
-     * '#' character.
+    r = pthread_create(&ctx->loader, NULL, loader_thread, ctx);
+    if (r != 0)
+        return -r;
 
-       org.freedesktop.login1.reboot="adm,wheel"
-       # reboot allowed only for adm group
-       org.freedesktop.login1.reboot="adm"
+    ctx->loader_running = true;
 
-     */
+    return 0;
+}
 
-    /* allocate memory for storing the data */
-    while (fgets(buf, sizeof(buf), f)) {
-        if (strlen(buf) == 0) {
-            /* '\0' in line */
-            continue;
-        }
-        else if (buf[0] == '#') {
-            /* a comment */
-            continue;
-        }
-        else if (buf[0] == '\n') {
-            /* a newline */
-            continue;
-        }
+static void save_state(struct context *ctx)
+{
+    struct snapshot snapshot = {
+        .policy = ctx->engine.policy,
+        .groups = ctx->engine.groups,
+        .action_requests = ctx->engine.action_requests,
+        .policy_file_id = ctx->policy_file_id,
+        .group_file_id = ctx->group_file_id,
+    };
+    int r;
+
+    r = snapshot_save(STATE_FILE, ctx->policy_file, &snapshot);
+
+    /* the state directory only exists when running as a service */
+    if (r < 0 && r != -ENOENT)
+        fprintf(stderr, "Error saving policy snapshot: %s\n", strerror(-r));
+}
+
+static void store_state(struct context *ctx)
+{
+    struct snapshot snapshot = {
+        .policy = ctx->engine.policy,
+        .groups = ctx->engine.groups,
+        .action_requests = ctx->engine.action_requests,
+        .policy_file_id = ctx->policy_file_id,
+        .group_file_id = ctx->group_file_id,
+    };
+    int fd, r;
+
+    /* Also hand the state over to the next instance through the systemd
+     * file descriptor store, which doesn't depend on the file system. */
+
+    if (!getenv("NOTIFY_SOCKET"))
+        return;
 
-        data = realloc(data, sizeof(struct line_data)*(n_lines+1));
-        memcpy(data[n_lines].buf, buf, LINE_BUF_SIZE);
-        n_lines++;
+    fd = memfd_create("groupcheck-state", MFD_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Error creating state memfd: %s\n", strerror(errno));
+        return;
     }
 
-    /* allocate one more line item to be a sentinel and zero it */
-    data = realloc(data, sizeof(struct line_data)*(n_lines+1));
-    memset(&data[n_lines], 0, sizeof(struct line_data));
+    r = snapshot_save_fd(fd, ctx->policy_file, &snapshot);
+    if (r == 0)
+        r = sd_pid_notify_with_fds(0, 0, "FDSTORE=1\nFDNAME=" FDSTORE_STATE_NAME, &fd, 1);
 
-    /* parse the lines */
-    for (i = 0; i < n_lines; i++) {
-        r = parse_line(&data[i]);
-        if (r < 0) {
-            fclose(f);
-            free(data);
-            return NULL;
-        }
+    if (r < 0)
+        fprintf(stderr, "Error storing state: %s\n", strerror(-r));
+
+    close(fd);
+}
+
+static int take_stored_state(void)
+{
+    char **names = NULL;
+    int n, i, fd = -1;
+
+    n = sd_listen_fds_with_names(1, &names);
+    if (n <= 0)
+        return -1;
+
+    for (i = 0; i < n; i++) {
+        if (fd < 0 && names && strcmp(names[i], FDSTORE_STATE_NAME) == 0)
+            fd = SD_LISTEN_FDS_START + i;
+        else
+            close(SD_LISTEN_FDS_START + i);
     }
 
-    fclose(f);
+    for (i = 0; names && i < n; i++)
+        free(names[i]);
+    free(names);
 
-    return data;
+    /* The state is consumed now. Drop it from the store, so that it isn't
+     * passed again if this instance dies without storing a newer one. */
+    if (fd >= 0)
+        sd_notify(0, "FDSTOREREMOVE=1\nFDNAME=" FDSTORE_STATE_NAME);
+
+    return fd;
 }
 
-static const char *find_policy_file()
+static void release_name(sd_bus *bus)
 {
-    struct stat s;
-    const char *dynamic_conf = "/etc/groupcheck.policy";
-    const char *default_conf = "/usr/share/defaults/etc/groupcheck.policy";
+    int r;
 
-    if (stat(dynamic_conf, &s) == 0)
-        return dynamic_conf;
-    else if (stat(default_conf, &s) == 0)
-        return default_conf;
+    /* Stop new requests from being routed to us. Everything sent to us
+     * before the release is already queued on our connection, so answer
+     * those before closing it. */
 
-    return NULL;
+    r = sd_bus_release_name(bus, SERVICE_NAME);
+    if (r < 0)
+        fprintf(stderr, "Error releasing service name: %s\n", strerror(-r));
+
+    do {
+        r = sd_bus_process(bus, NULL);
+    } while (r > 0);
+
+    sd_bus_flush(bus);
+}
+
+static int on_name_lost(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+    /* a new instance has taken over the service name */
+    fprintf(stdout, "Service name taken over by another instance.\n");
+
+    return sd_event_exit(sd_bus_get_event(sd_bus_message_get_bus(m)), 0);
+}
+
+static int on_idle_timer(sd_event_source *s, uint64_t usec, void *userdata)
+{
+    struct context *ctx = userdata;
+    uint64_t deadline;
+    int r;
+
+    /* requests to the workers count too */
+    if (ctx->workers)
+        ctx->last_activity = workers_last_activity(ctx->workers, ctx->last_activity);
+
+    deadline = ctx->last_activity + ctx->idle_timeout;
+
+    if (usec < deadline) {
+        /* there were requests meanwhile, wait for the rest of the period */
+        r = sd_event_source_set_time(s, deadline);
+        if (r < 0)
+            return r;
+
+        return sd_event_source_set_enabled(s, SD_EVENT_ONESHOT);
+    }
+
+    /* The shutdown path releases the name and answers the requests that are
+     * already queued. Requests that come after that start a new instance
+     * through bus activation. */
+    fprintf(stdout, "Exiting after %llu seconds without requests.\n",
+            (unsigned long long) (ctx->idle_timeout / 1000000ULL));
+
+    return sd_event_exit(sd_event_source_get_event(s), 0);
+}
+
+static int on_heavy_decay(sd_event_source *s, uint64_t usec, void *userdata)
+{
+    struct context *ctx = userdata;
+    int i, r;
+
+    /* the workers count on their own, fold that in before halving */
+    if (ctx->workers && ctx->load_state == LOAD_DONE) {
+        pause_workers(ctx->workers);
+        collect_worker_counters(ctx);
+        resume_workers(ctx->workers, false);
+    }
+
+    for (i = 0; i < N_HEAVY; i++)
+        heavy_hitters_decay(ctx->heavy[i]);
+
+    r = sd_event_source_set_time(s, usec + HEAVY_HALF_LIFE_USEC);
+    if (r < 0)
+        return r;
+
+    return sd_event_source_set_enabled(s, SD_EVENT_ONESHOT);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [options]\n"
+            "  -c, --cache-budget=BYTES  memory budget for all caches (default %d)\n"
+            "  -t, --idle-timeout=SECS   exit after SECS without requests (default never)\n"
+            "  -l, --listen=PATH         also serve direct connections on a socket\n"
+            "  -m, --listen-mode=MODE    access mode of the socket (default %04o)\n"
+            "  -j, --threads=N           threads for the direct connections (default CPUs)\n"
+            "  -p, --policy=FILE         read the policy from FILE\n"
+            "  -h, --help                show this help\n",
+            name, DEFAULT_CACHE_BUDGET, DEFAULT_LISTEN_MODE);
 }
 
 int main(int argc, char *argv[])
@@ -805,43 +3047,248 @@ int main(int argc, char *argv[])
     sd_event *e = NULL;
     sd_bus *bus = NULL;
     sd_bus_slot *slot = NULL;
-    struct line_data *data = NULL;
-    int r = -1;
-    const char *policy_file;
+    struct context ctx = { .pressure_fd = -1, .state_fd = -1, .loaded_fd = -1 };
+    int r = -1, i, opt;
+    bool serving = false;
+    sigset_t mask;
+    size_t cache_budget = DEFAULT_CACHE_BUDGET;
+    unsigned long idle_seconds;
+    const char *listen_path = NULL;
+    unsigned long listen_mode = DEFAULT_LISTEN_MODE;
+    long n_threads = 0;
+    char *endp;
+    static const struct option options[] = {
+        { "cache-budget", required_argument, NULL, 'c' },
+        { "idle-timeout", required_argument, NULL, 't' },
+        { "listen", required_argument, NULL, 'l' },
+        { "listen-mode", required_argument, NULL, 'm' },
+        { "threads", required_argument, NULL, 'j' },
+        { "policy", required_argument, NULL, 'p' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    while ((opt = getopt_long(argc, argv, "c:t:l:m:j:p:h", options, NULL)) != -1) {
+        switch (opt) {
+        case 'c':
+            errno = 0;
+            cache_budget = strtoul(optarg, &endp, 10);
+            if (errno != 0 || *optarg == '\0' || *endp != '\0') {
+                fprintf(stderr, "Invalid cache budget: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 't':
+            errno = 0;
+            idle_seconds = strtoul(optarg, &endp, 10);
+            if (errno != 0 || *optarg == '\0' || *endp != '\0') {
+                fprintf(stderr, "Invalid idle timeout: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            ctx.idle_timeout = idle_seconds * 1000000ULL;
+            break;
+        case 'l':
+            listen_path = optarg;
+            break;
+        case 'm':
+            errno = 0;
+            listen_mode = strtoul(optarg, &endp, 8);
+            if (errno != 0 || *optarg == '\0' || *endp != '\0' || listen_mode > 0777) {
+                fprintf(stderr, "Invalid socket mode: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'j':
+            errno = 0;
+            n_threads = strtol(optarg, &endp, 10);
+            if (errno != 0 || *optarg == '\0' || *endp != '\0' ||
+                    n_threads < 1 || n_threads > 1024) {
+                fprintf(stderr, "Invalid number of threads: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'p':
+            ctx.policy_file = optarg;
+            break;
+        case 'h':
+            usage(argv[0]);
+            return EXIT_SUCCESS;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
 
-    policy_file = find_policy_file();
-    if (!policy_file) {
+    if (!ctx.policy_file)
+        ctx.policy_file = find_policy_file();
+    if (!ctx.policy_file) {
         fprintf(stderr, "Error finding policy data file.\n");
         goto end;
     }
 
-    data = load_file(policy_file);
-    if (!data) {
-        fprintf(stderr, "Error loading policy data.\n");
+    ctx.state_fd = take_stored_state();
+
+    ctx.budget = cache_budget_new(cache_budget);
+    if (!ctx.budget) {
+        fprintf(stderr, "Error allocating caches.\n");
+        r = -ENOMEM;
+        goto end;
+    }
+
+    r = engine_init(&ctx.engine, &system_provider, &ctx, ctx.budget);
+    if (r < 0) {
+        fprintf(stderr, "Error allocating caches.\n");
+        goto end;
+    }
+
+    r = new_heavy_hitters(&ctx);
+    if (r < 0) {
+        fprintf(stderr, "Error allocating request statistics.\n");
         goto end;
     }
 
+    for (i = 0; i < PENDING_POOL_SIZE; i++) {
+        ctx.pending_pool[i].next = ctx.pending_free;
+        ctx.pending_free = &ctx.pending_pool[i];
+    }
+
+    if (listen_path) {
+        if (n_threads == 0)
+            n_threads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+
+        /* the threads are started once the policy is there */
+        r = new_workers(&ctx, listen_path, listen_mode, n_threads, cache_budget);
+        if (r < 0) {
+            fprintf(stderr, "Error listening on %s: %s\n", listen_path, strerror(-r));
+            goto end;
+        }
+    }
+
     r = sd_event_default(&e);
     if (r < 0) {
         fprintf(stderr, "Error initializing default event: %s\n", strerror(-r));
         goto end;
     }
 
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGINT);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    /* exit the event loop cleanly, so that the state can be saved */
+
+    r = sd_event_add_signal(e, NULL, SIGTERM, on_exit_signal, NULL);
+    if (r < 0) {
+        fprintf(stderr, "Error adding signal handler: %s\n", strerror(-r));
+        goto end;
+    }
+
+    r = sd_event_add_signal(e, NULL, SIGINT, on_exit_signal, NULL);
+    if (r < 0) {
+        fprintf(stderr, "Error adding signal handler: %s\n", strerror(-r));
+        goto end;
+    }
+
+    r = sd_event_add_signal(e, NULL, SIGHUP, on_reload_signal, &ctx);
+    if (r < 0) {
+        fprintf(stderr, "Error adding signal handler: %s\n", strerror(-r));
+        goto end;
+    }
+
+    /* the generation the loaded groups belong to */
+    update_group_generation(&ctx);
+
+    /* Load the policy while the bus connection is set up and the name is
+     * claimed. Requests are queued until the policy is ready. The signals
+     * are blocked already, so that the loader thread inherits the mask. */
+
+    r = start_loading(&ctx, e);
+    if (r < 0) {
+        fprintf(stderr, "Error starting policy loader: %s\n", strerror(-r));
+        goto end;
+    }
+
+    r = watch_memory_pressure(&ctx, e);
+    if (r < 0) {
+        /* not fatal, the caches are bounded anyway */
+        fprintf(stderr, "Not monitoring memory pressure: %s\n", strerror(-r));
+    }
+
+    r = sd_event_add_time(e, NULL, CLOCK_MONOTONIC, cache_now() + HEAVY_HALF_LIFE_USEC,
+            0, on_heavy_decay, &ctx);
+    if (r < 0) {
+        fprintf(stderr, "Error adding statistics timer: %s\n", strerror(-r));
+        goto end;
+    }
+
+    r = sd_event_add_inotify(e, NULL, GROUP_FILE_DIR,
+            IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE,
+            on_group_file_changed, &ctx);
+    if (r < 0) {
+        fprintf(stderr, "Error watching group database: %s\n", strerror(-r));
+        goto end;
+    }
+
+    r = watch_sessions(&ctx, e);
+    if (r < 0) {
+        fprintf(stderr, "Error watching login sessions: %s\n", strerror(-r));
+        goto end;
+    }
+
     r = sd_bus_open_system(&bus);
     if (r < 0) {
         fprintf(stderr, "Error connecting to bus: %s\n", strerror(-r));
         goto end;
     }
 
+    ctx.bus = bus;
+
     r = sd_bus_add_object_vtable(bus, &slot,
-            "/org/freedesktop/PolicyKit1/Authority",
-            "org.freedesktop.PolicyKit1.Authority", polkit_vtable, data);
+            AUTHORITY_PATH, AUTHORITY_INTERFACE, polkit_vtable, &ctx);
+    if (r < 0) {
+        fprintf(stderr, "Error creating D-Bus object: %s\n", strerror(-r));
+        goto end;
+    }
+
+    r = sd_bus_add_object_vtable(bus, NULL, AUTHORITY_PATH,
+            "org.groupcheck.Authority1", authority_vtable, &ctx);
+    if (r < 0) {
+        fprintf(stderr, "Error creating D-Bus object: %s\n", strerror(-r));
+        goto end;
+    }
+
+    r = sd_bus_add_object_vtable(bus, NULL, AUTHORITY_PATH,
+            "org.groupcheck.Statistics1", statistics_vtable, &ctx);
     if (r < 0) {
         fprintf(stderr, "Error creating D-Bus object: %s\n", strerror(-r));
         goto end;
     }
 
-    r = sd_bus_request_name(bus, "org.freedesktop.PolicyKit1", 0);
+    r = sd_bus_add_match(bus, NULL,
+            "type='signal',sender='org.freedesktop.DBus',"
+            "interface='org.freedesktop.DBus',member='NameOwnerChanged'",
+            on_name_owner_changed, &ctx);
+    if (r < 0) {
+        fprintf(stderr, "Error subscribing to bus name changes: %s\n", strerror(-r));
+        goto end;
+    }
+
+    r = sd_bus_add_match(bus, NULL,
+            "type='signal',sender='org.freedesktop.DBus',"
+            "interface='org.freedesktop.DBus',member='NameLost',"
+            "arg0='" SERVICE_NAME "'",
+            on_name_lost, &ctx);
+    if (r < 0) {
+        fprintf(stderr, "Error subscribing to bus name changes: %s\n", strerror(-r));
+        goto end;
+    }
+
+    /* Take the name over from a previous instance that is still running, and
+     * let the next instance take it from us in the same way. The transfer is
+     * atomic, so the name is never without an owner. */
+    r = sd_bus_request_name(bus, SERVICE_NAME,
+            SD_BUS_NAME_REPLACE_EXISTING | SD_BUS_NAME_ALLOW_REPLACEMENT);
     if (r < 0) {
         fprintf(stderr, "Error requesting service name: %s\n", strerror(-r));
         goto end;
@@ -853,17 +3300,66 @@ int main(int argc, char *argv[])
         goto end;
     }
 
+    if (ctx.idle_timeout > 0) {
+        sd_event_now(e, CLOCK_MONOTONIC, &ctx.last_activity);
+
+        r = sd_bus_add_filter(bus, NULL, on_message, &ctx);
+        if (r < 0) {
+            fprintf(stderr, "Error adding message filter: %s\n", strerror(-r));
+            goto end;
+        }
+
+        r = sd_event_add_time(e, NULL, CLOCK_MONOTONIC,
+                ctx.last_activity + ctx.idle_timeout, 0, on_idle_timer, &ctx);
+        if (r < 0) {
+            fprintf(stderr, "Error adding idle timer: %s\n", strerror(-r));
+            goto end;
+        }
+    }
+
+    serving = true;
+
     r = sd_event_loop(e);
     if (r < 0) {
         fprintf(stderr, "Exited from event loop with error: %s\n", strerror(-r));
     }
 
 end:
+    /* queued requests are answered before the name is released */
+    if (finish_loading(&ctx) < 0 && r >= 0)
+        r = ctx.load_result;
+
+    /* the counters of the workers go to the saved state too */
+    free_workers(&ctx);
+
+    if (serving) {
+        release_name(bus);
+
+        if (ctx.load_state == LOAD_DONE) {
+            save_state(&ctx);
+            store_state(&ctx);
+        }
+    }
+
+    if (ctx.state_fd >= 0)
+        close(ctx.state_fd);
+
+    if (ctx.loaded_fd >= 0)
+        close(ctx.loaded_fd);
+
     sd_bus_slot_unref(slot);
     sd_bus_unref(bus);
     sd_event_unref(e);
 
-    free(data);
+    if (ctx.pressure_fd >= 0)
+        close(ctx.pressure_fd);
+
+    sd_login_monitor_unref(ctx.login_monitor);
+
+    action_index_free(ctx.action_index);
+    engine_done(&ctx.engine);
+    cache_budget_free(ctx.budget);
+    free_heavy_hitters(&ctx);
 
     fprintf(stdout, "Exiting daemon.\n");
 
@@ -0,0 +1,186 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "heavy.h"
+
+struct counter {
+    uint64_t hash;
+    uint64_t weight;
+    uint64_t error;
+    char key[HEAVY_KEY_SIZE];
+};
+
+struct heavy_hitters {
+    unsigned int capacity;
+    unsigned int n_counters;
+    uint64_t total;
+    struct counter counters[];
+};
+
+static uint64_t hash_key(const char *key)
+{
+    /* FNV-1a */
+    uint64_t h = 14695981039346656037ULL;
+
+    for (; *key; key++) {
+        h ^= (unsigned char) *key;
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+struct heavy_hitters *heavy_hitters_new(unsigned int capacity)
+{
+    struct heavy_hitters *h;
+
+    h = calloc(1, sizeof(struct heavy_hitters) + capacity * sizeof(struct counter));
+    if (!h)
+        return NULL;
+
+    h->capacity = capacity;
+
+    return h;
+}
+
+void heavy_hitters_free(struct heavy_hitters *h)
+{
+    free(h);
+}
+
+static void add_counted(struct heavy_hitters *h, uint64_t hash, const char *key,
+        uint64_t weight, uint64_t error)
+{
+    struct counter *c, *min = NULL;
+    unsigned int i;
+
+    /* The counters are few, so a scan is cheaper than keeping an index.
+     * The smallest one is found on the way in case the key isn't there. */
+    for (i = 0; i < h->n_counters; i++) {
+        c = &h->counters[i];
+
+        if (c->hash == hash && strncmp(c->key, key, HEAVY_KEY_SIZE - 1) == 0) {
+            c->weight += weight;
+            c->error += error;
+            return;
+        }
+
+        if (!min || c->weight < min->weight)
+            min = c;
+    }
+
+    if (h->n_counters < h->capacity) {
+        c = &h->counters[h->n_counters++];
+        c->weight = 0;
+        c->error = 0;
+    }
+    else {
+        /* the new key may have had the weight of the evicted one */
+        c = min;
+        c->error = c->weight;
+    }
+
+    c->hash = hash;
+    c->weight += weight;
+    c->error += error;
+    strncpy(c->key, key, HEAVY_KEY_SIZE - 1);
+    c->key[HEAVY_KEY_SIZE - 1] = '\0';
+}
+
+void heavy_hitters_add(struct heavy_hitters *h, const char *key, uint64_t weight)
+{
+    if (!h || h->capacity == 0)
+        return;
+
+    h->total += weight;
+    add_counted(h, hash_key(key), key, weight, 0);
+}
+
+void heavy_hitters_merge(struct heavy_hitters *h, struct heavy_hitters *from)
+{
+    unsigned int i;
+
+    if (h->capacity > 0) {
+        for (i = 0; i < from->n_counters; i++) {
+            struct counter *c = &from->counters[i];
+
+            add_counted(h, c->hash, c->key, c->weight, c->error);
+        }
+    }
+
+    h->total += from->total;
+    heavy_hitters_reset(from);
+}
+
+void heavy_hitters_reset(struct heavy_hitters *h)
+{
+    h->n_counters = 0;
+    h->total = 0;
+}
+
+void heavy_hitters_decay(struct heavy_hitters *h)
+{
+    unsigned int i;
+
+    /* the order of the counters and the error bounds stay the same */
+    for (i = 0; i < h->n_counters; i++) {
+        h->counters[i].weight /= 2;
+        h->counters[i].error /= 2;
+    }
+
+    h->total /= 2;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    const struct heavy_entry *x = a, *y = b;
+
+    return x->weight > y->weight ? -1 : x->weight < y->weight;
+}
+
+unsigned int heavy_hitters_top(struct heavy_hitters *h, struct heavy_entry *top,
+        unsigned int n)
+{
+    struct heavy_entry all[h->n_counters + 1];
+    unsigned int i;
+
+    for (i = 0; i < h->n_counters; i++) {
+        memcpy(all[i].key, h->counters[i].key, HEAVY_KEY_SIZE);
+        all[i].weight = h->counters[i].weight;
+        all[i].error = h->counters[i].error;
+    }
+
+    qsort(all, h->n_counters, sizeof(struct heavy_entry), compare_entries);
+
+    if (n > h->n_counters)
+        n = h->n_counters;
+
+    memcpy(top, all, n * sizeof(struct heavy_entry));
+
+    return n;
+}
+
+uint64_t heavy_hitters_total(struct heavy_hitters *h)
+{
+    return h->total;
+}
+
+size_t heavy_hitters_bytes(struct heavy_hitters *h)
+{
+    return sizeof(struct heavy_hitters) + h->capacity * sizeof(struct counter);
+}
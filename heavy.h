@@ -0,0 +1,67 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+
+#ifndef GROUPCHECK_HEAVY_H
+#define GROUPCHECK_HEAVY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Heavy hitters: the keys with the largest total weight in a stream, in
+ * bounded memory. This is the space-saving algorithm. There is a fixed
+ * number of counters, and a key without one takes over the counter with
+ * the smallest weight and adds to it. The weight of a key is then
+ * overestimated by at most the weight it took over, which is kept as the
+ * error of the counter. Any key with more than total / capacity of the
+ * weight is sure to have a counter. */
+
+/* longer keys are cut, but told apart by their hash */
+#define HEAVY_KEY_SIZE 64
+
+struct heavy_hitters;
+
+struct heavy_entry {
+    char key[HEAVY_KEY_SIZE];
+    uint64_t weight;
+    /* how much of the weight may belong to other keys */
+    uint64_t error;
+};
+
+struct heavy_hitters *heavy_hitters_new(unsigned int capacity);
+void heavy_hitters_free(struct heavy_hitters *h);
+
+void heavy_hitters_add(struct heavy_hitters *h, const char *key, uint64_t weight);
+
+/* Add the counters of another summary to this one and reset it. The
+ * result has the same error bounds as if both streams had been added
+ * here. */
+void heavy_hitters_merge(struct heavy_hitters *h, struct heavy_hitters *from);
+
+void heavy_hitters_reset(struct heavy_hitters *h);
+
+/* Halve all weights, so that the summary follows the recent stream. */
+void heavy_hitters_decay(struct heavy_hitters *h);
+
+/* Copy at most n entries to top, heaviest first. Returns the number of
+ * entries copied. */
+unsigned int heavy_hitters_top(struct heavy_hitters *h, struct heavy_entry *top,
+        unsigned int n);
+
+/* the weight of everything that was added */
+uint64_t heavy_hitters_total(struct heavy_hitters *h);
+
+size_t heavy_hitters_bytes(struct heavy_hitters *h);
+
+#endif /* GROUPCHECK_HEAVY_H */
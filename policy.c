@@ -0,0 +1,950 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+
+#include "policy.h"
+
+#define LINE_BUF_SIZE 4096
+
+/* Limits for one rule. The groups of a rule are numbered in a 64-bit mask,
+ * and the rule is kept as a list of terms, any of which must match. */
+#define MAX_RULE_GROUPS 64
+#define MAX_RULE_TERMS 64
+#define MAX_RULE_DEPTH 16
+
+#define POLICY_MAGIC 0x4c504347 /* "GCPL" */
+#define POLICY_VERSION 3
+#define POLICY_NONE UINT32_MAX
+
+/* the rule is a plain list of groups, any of which allows the action */
+#define ACTION_FLAG_LIST 0x1
+
+/* A term matches a subject that is in all of the required groups and in
+ * none of the forbidden ones. Bit i refers to the i:th group of the rule. */
+
+struct term {
+    uint64_t require;
+    uint64_t forbid;
+};
+
+struct term_list {
+    int n_terms;
+    struct term terms[MAX_RULE_TERMS];
+};
+
+/* file parser results */
+
+struct line_data {
+    char *buf;
+    char *id;
+    char *expr;
+    /* group names, stored in names */
+    int n_groups;
+    char **groups;
+    char *names;
+    int n_terms;
+    struct term *terms;
+    bool is_list;
+};
+
+struct expr_parser {
+    const char *p;
+    struct line_data *data;
+    char *names_end;
+    int depth;
+};
+
+/* compiled policy layout */
+
+struct policy_action {
+    uint32_t id;            /* offset in strings */
+    uint32_t hash;
+    uint32_t next;          /* next action in the same hash bucket */
+    uint32_t first_group;   /* index in group_refs */
+    uint32_t n_groups;
+    uint32_t first_term;    /* index in terms */
+    uint32_t n_terms;
+    uint32_t flags;
+};
+
+/* the masks are split in two words to keep the block 4-byte aligned */
+
+struct policy_term {
+    uint32_t require[2];
+    uint32_t forbid[2];
+};
+
+struct policy_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t n_actions;
+    uint32_t n_buckets;
+    uint32_t n_group_refs;
+    uint32_t n_groups;
+    uint32_t n_terms;
+    uint32_t strings_size;
+};
+
+/* The block is laid out as: header, actions, terms, buckets, group_refs,
+ * groups (string offsets of the group names), group_actions, strings.
+ * group_actions has a bitmap for every group, action_words(n_actions) words
+ * each, of the actions with a plain group list that includes the group. */
+
+struct policy {
+    struct policy_header h;
+};
+
+static struct policy_action *actions(const struct policy *p)
+{
+    return (struct policy_action *) (p + 1);
+}
+
+static struct policy_term *terms(const struct policy *p)
+{
+    return (struct policy_term *) (actions(p) + p->h.n_actions);
+}
+
+static uint32_t *buckets(const struct policy *p)
+{
+    return (uint32_t *) (terms(p) + p->h.n_terms);
+}
+
+static uint32_t *group_refs(const struct policy *p)
+{
+    return buckets(p) + p->h.n_buckets;
+}
+
+static uint32_t *groups(const struct policy *p)
+{
+    return group_refs(p) + p->h.n_group_refs;
+}
+
+static uint32_t action_words(uint32_t n_actions)
+{
+    return (n_actions + 31) / 32;
+}
+
+static uint32_t *group_actions(const struct policy *p)
+{
+    return groups(p) + p->h.n_groups;
+}
+
+static char *strings(const struct policy *p)
+{
+    return (char *) (group_actions(p) + p->h.n_groups * action_words(p->h.n_actions));
+}
+
+static size_t layout_size(uint32_t n_actions, uint32_t n_terms, uint32_t n_buckets,
+        uint32_t n_group_refs, uint32_t n_groups, uint32_t strings_size)
+{
+    return sizeof(struct policy) + n_actions * sizeof(struct policy_action)
+            + (size_t) n_terms * sizeof(struct policy_term)
+            + (n_buckets + n_group_refs + n_groups) * sizeof(uint32_t)
+            + (size_t) n_groups * action_words(n_actions) * sizeof(uint32_t)
+            + strings_size;
+}
+
+static uint32_t hash_string(const char *s)
+{
+    /* FNV-1a */
+    uint32_t h = 2166136261U;
+
+    while (*s) {
+        h ^= (unsigned char) *s++;
+        h *= 16777619U;
+    }
+
+    return h;
+}
+
+/* Group expressions are parsed straight into disjunctive normal form. A
+ * negation is pushed down to the group names, so "!(a|b)" becomes the
+ * single term "!a&!b". Under a negation, "|" turns into a product of the
+ * term lists and "&" into a union, and the other way round without one. */
+
+static bool is_operator(char c)
+{
+    return c == ',' || c == '|' || c == '&' || c == '!' || c == '(' ||
+            c == ')' || c == '"' || c == '\0' || c == '\n';
+}
+
+/* the characters around a list entry */
+
+static bool starts_entry(char c)
+{
+    return c == ',' || c == '|' || c == '(' || c == '"';
+}
+
+static bool ends_entry(char c)
+{
+    return c == ',' || c == '|' || c == ')' || c == '"';
+}
+
+static int list_union(struct term_list *a, const struct term_list *b)
+{
+    int i;
+
+    if (a->n_terms + b->n_terms > MAX_RULE_TERMS)
+        return -E2BIG;
+
+    for (i = 0; i < b->n_terms; i++)
+        a->terms[a->n_terms++] = b->terms[i];
+
+    return 0;
+}
+
+static int list_product(struct term_list *a, const struct term_list *b)
+{
+    struct term_list result = { 0 };
+    int i, j;
+
+    for (i = 0; i < a->n_terms; i++) {
+        for (j = 0; j < b->n_terms; j++) {
+            struct term t = {
+                .require = a->terms[i].require | b->terms[j].require,
+                .forbid = a->terms[i].forbid | b->terms[j].forbid,
+            };
+
+            /* "a&!a" never matches */
+            if (t.require & t.forbid)
+                continue;
+
+            if (result.n_terms >= MAX_RULE_TERMS)
+                return -E2BIG;
+
+            result.terms[result.n_terms++] = t;
+        }
+    }
+
+    *a = result;
+
+    return 0;
+}
+
+static int parse_or(struct expr_parser *ep, bool negated, struct term_list *out);
+
+static int parse_group(struct expr_parser *ep, bool negated, struct term_list *out)
+{
+    struct line_data *data = ep->data;
+    const char *start = ep->p;
+    size_t len;
+    int i;
+
+    while (!is_operator(*ep->p))
+        ep->p++;
+
+    len = ep->p - start;
+
+    /* An empty name, as in "adm,,wheel" or "adm,", is a group that nobody
+     * is in, like any group missing from the group database. It can only be
+     * a whole list entry: an operator without an operand, as in "!" or
+     * "adm&", is an error, and so are empty parentheses. The expression
+     * starts after a quote, so start[-1] is always there. */
+    if (len == 0) {
+        if (!starts_entry(start[-1]) || !ends_entry(*ep->p) ||
+                (start[-1] == '(' && *ep->p == ')'))
+            return -EINVAL;
+
+        out->n_terms = negated ? 1 : 0;
+        out->terms[0].require = 0;
+        out->terms[0].forbid = 0;
+        return 0;
+    }
+
+    for (i = 0; i < data->n_groups; i++) {
+        if (strlen(data->groups[i]) == len && strncmp(data->groups[i], start, len) == 0)
+            break;
+    }
+
+    if (i == data->n_groups) {
+        if (data->n_groups >= MAX_RULE_GROUPS)
+            return -E2BIG;
+
+        data->groups[data->n_groups++] = ep->names_end;
+        memcpy(ep->names_end, start, len);
+        ep->names_end[len] = '\0';
+        ep->names_end += len + 1;
+    }
+
+    out->n_terms = 1;
+    out->terms[0].require = negated ? 0 : 1ULL << i;
+    out->terms[0].forbid = negated ? 1ULL << i : 0;
+
+    return 0;
+}
+
+static int parse_unary(struct expr_parser *ep, bool negated, struct term_list *out)
+{
+    int r;
+
+    if (*ep->p == '!') {
+        ep->p++;
+        ep->data->is_list = false;
+        return parse_unary(ep, !negated, out);
+    }
+
+    if (*ep->p == '(') {
+        if (++ep->depth > MAX_RULE_DEPTH)
+            return -E2BIG;
+
+        ep->p++;
+        r = parse_or(ep, negated, out);
+        if (r < 0)
+            return r;
+
+        if (*ep->p != ')')
+            return -EINVAL;
+
+        ep->p++;
+        ep->depth--;
+        ep->data->is_list = false;
+        return 0;
+    }
+
+    return parse_group(ep, negated, out);
+}
+static int parse_and(struct expr_parser *ep, bool negated, struct term_list *out)
+{
+    struct term_list next;
+    int r;
+
+    r = parse_unary(ep, negated, out);
+    if (r < 0)
+        return r;
+
+    while (*ep->p == '&') {
+        ep->p++;
+        ep->data->is_list = false;
+
+        r = parse_unary(ep, negated, &next);
+        if (r < 0)
+            return r;
+
+        r = negated ? list_union(out, &next) : list_product(out, &next);
+        if (r < 0)
+            return r;
+    }
+
+    return 0;
+}
+
+static int parse_or(struct expr_parser *ep, bool negated, struct term_list *out)
+{
+    struct term_list next;
+    int r;
+
+    r = parse_and(ep, negated, out);
+    if (r < 0)
+        return r;
+
+    while (*ep->p == ',' || *ep->p == '|') {
+        ep->p++;
+
+        r = parse_and(ep, negated, &next);
+        if (r < 0)
+            return r;
+
+        r = negated ? list_product(out, &next) : list_union(out, &next);
+        if (r < 0)
+            return r;
+    }
+
+    return 0;
+}
+
+static int parse_rule(struct line_data *data)
+{
+    struct expr_parser ep = { .p = data->expr, .data = data };
+    struct term_list *list;
+    size_t max_groups;
+    int r;
+
+    data->is_list = true;
+
+    /* an empty rule allows nobody */
+    if (*data->expr == '"')
+        return 0;
+
+    /* The names are never longer than the expression they come from, and
+     * each takes at least two characters with its separator. */
+    max_groups = strlen(data->expr) / 2 + 1;
+    if (max_groups > MAX_RULE_GROUPS)
+        max_groups = MAX_RULE_GROUPS;
+
+    data->names = malloc(strlen(data->expr) + 1);
+    data->groups = malloc(max_groups * sizeof(char *));
+    list = malloc(sizeof(struct term_list));
+    if (!data->names || !data->groups || !list) {
+        free(list);
+        return -ENOMEM;
+    }
+
+    ep.names_end = data->names;
+
+    r = parse_or(&ep, false, list);
+    if (r == 0 && *ep.p != '"')
+        r = -EINVAL;
+
+    /* a rule of empty names allows nobody, like an empty rule */
+    if (r == 0 && list->n_terms > 0) {
+        data->terms = malloc(list->n_terms * sizeof(struct term));
+        if (data->terms) {
+            memcpy(data->terms, list->terms, list->n_terms * sizeof(struct term));
+            data->n_terms = list->n_terms;
+        }
+        else {
+            r = -ENOMEM;
+        }
+    }
+
+    free(list);
+
+    return r;
+}
+
+static int parse_line(struct line_data *data)
+{
+    char *p;
+    int r;
+
+    /* data->buf has already been initialized with the raw data */
+
+    p = data->id = data->buf;
+
+    p = strchr(p, '=');
+    if (!p) {
+        fprintf(stderr, "Error parsing configuration file.\n");
+        return -EINVAL;
+    }
+
+    *p++ = '\0';
+
+    if (*p != '"') {
+        fprintf(stderr, "Error parsing configuration file.\n");
+        return -EINVAL;
+    }
+
+    data->expr = p + 1;
+
+    r = parse_rule(data);
+    if (r == -E2BIG) {
+        fprintf(stderr, "Error: the rule of %s is too complex.\n", data->id);
+        return r;
+    }
+    else if (r < 0) {
+        fprintf(stderr, "Error parsing configuration file.\n");
+        return r;
+    }
+
+    return 0;
+}
+
+static void free_lines(struct line_data *data)
+{
+    int i;
+
+    if (!data)
+        return;
+
+    for (i = 0; data[i].buf; i++) {
+        free(data[i].buf);
+        free(data[i].names);
+        free(data[i].groups);
+        free(data[i].terms);
+    }
+
+    free(data);
+}
+
+static struct line_data * load_file(const char *filename)
+{
+    FILE *f;
+    char *buf;
+    int n_lines = 0;
+    int r, i;
+    struct line_data *data = NULL, *tmp;
+
+    f = fopen(filename, "r");
+
+    if (f == NULL)
+        return NULL;
+
+    buf = malloc(LINE_BUF_SIZE);
+    data = calloc(1, sizeof(struct line_data));
+    if (!buf || !data)
+        goto fail;
+
+    /* The configuration file must be of following format. No whitespaces
+     * are allowed except for newlines. First part of the line is the action-id.
+     * It is followed by an equation mark and then the group expression
+     * inside double quotation marks. Comments are lines starting with
+     * '#' character.
+
+       org.freedesktop.login1.reboot="adm,wheel"
+       # reboot allowed only for adm group
+       org.freedesktop.login1.reboot="adm"
+       # wheel members who aren't guests, and adm members
+       org.freedesktop.login1.power-off="wheel&!guests,adm"
+
+     * Group names are separated by operators: "!" (not), "&" (and), "," or
+     * "|" (or), in the order of precedence. Parentheses group
+     * subexpressions.
+     */
+
+    while (fgets(buf, LINE_BUF_SIZE, f)) {
+        if (strlen(buf) == 0) {
+            /* '\0' in line */
+            continue;
+        }
+        else if (buf[0] == '#') {
+            /* a comment */
+            continue;
+        }
+        else if (buf[0] == '\n') {
+            /* a newline */
+            continue;
+        }
+
+        if (buf[strlen(buf) - 1] != '\n' && !feof(f)) {
+            fprintf(stderr, "Error: line too long in configuration file.\n");
+            goto fail;
+        }
+
+        /* keep a zeroed sentinel item at the end */
+        tmp = realloc(data, sizeof(struct line_data)*(n_lines+2));
+        if (!tmp)
+            goto fail;
+        data = tmp;
+        memset(&data[n_lines], 0, 2 * sizeof(struct line_data));
+
+        data[n_lines].buf = strdup(buf);
+        if (!data[n_lines].buf)
+            goto fail;
+        n_lines++;
+    }
+
+    /* parse the lines */
+    for (i = 0; i < n_lines; i++) {
+        r = parse_line(&data[i]);
+        if (r < 0)
+            goto fail;
+    }
+
+    free(buf);
+    fclose(f);
+
+    return data;
+
+fail:
+    free_lines(data);
+    free(buf);
+    fclose(f);
+    return NULL;
+}
+
+static int find_line_action(struct line_data *data, int n, const char *id)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (strcmp(data[i].id, id) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+static uint32_t find_group_name(const char **group_names, uint32_t n_groups,
+        const char *name)
+{
+    uint32_t i;
+
+    for (i = 0; i < n_groups; i++) {
+        if (strcmp(group_names[i], name) == 0)
+            break;
+    }
+
+    return i;
+}
+
+static struct policy *compile(struct line_data *data, int n_lines)
+{
+    struct policy *p;
+    const char **group_names = NULL;
+    bool *skip = NULL;
+    uint32_t n_actions = 0, n_buckets = 1, n_group_refs = 0, n_groups = 0;
+    uint32_t n_terms = 0, strings_size = 0;
+    uint32_t a, i, ref, term, str;
+    size_t size;
+    int line, j;
+
+    /* room for every group reference, as if all names were different */
+    for (line = 0; line < n_lines; line++)
+        n_group_refs += data[line].n_groups;
+
+    skip = calloc(n_lines + 1, sizeof(bool));
+    group_names = calloc(n_group_refs + 1, sizeof(char *));
+    n_group_refs = 0;
+    if (!skip || !group_names) {
+        p = NULL;
+        goto end;
+    }
+
+    /* Count the sizes. If an action is listed many times, only the first
+     * line counts, like it always has. Group names are stored once. */
+
+    for (line = 0; line < n_lines; line++) {
+        if (find_line_action(data, line, data[line].id) >= 0) {
+            skip[line] = true;
+            continue;
+        }
+
+        n_actions++;
+        n_group_refs += data[line].n_groups;
+        n_terms += data[line].n_terms;
+        strings_size += strlen(data[line].id) + 1;
+
+        for (j = 0; j < data[line].n_groups; j++) {
+            i = find_group_name(group_names, n_groups, data[line].groups[j]);
+            if (i == n_groups) {
+                group_names[n_groups++] = data[line].groups[j];
+                strings_size += strlen(data[line].groups[j]) + 1;
+            }
+        }
+    }
+
+    while (n_buckets < n_actions)
+        n_buckets *= 2;
+
+    /* keep the whole block 4-byte aligned */
+    strings_size = (strings_size + 3) & ~3U;
+
+    size = layout_size(n_actions, n_terms, n_buckets, n_group_refs, n_groups,
+            strings_size);
+
+    p = calloc(1, size);
+    if (!p)
+        goto end;
+
+    p->h.magic = POLICY_MAGIC;
+    p->h.version = POLICY_VERSION;
+    p->h.size = size;
+    p->h.n_actions = n_actions;
+    p->h.n_buckets = n_buckets;
+    p->h.n_group_refs = n_group_refs;
+    p->h.n_groups = n_groups;
+    p->h.n_terms = n_terms;
+    p->h.strings_size = strings_size;
+
+    str = 0;
+
+    for (i = 0; i < n_groups; i++) {
+        groups(p)[i] = str;
+        strcpy(strings(p) + str, group_names[i]);
+        str += strlen(group_names[i]) + 1;
+    }
+
+    for (i = 0; i < n_buckets; i++)
+        buckets(p)[i] = POLICY_NONE;
+
+    a = 0;
+    ref = 0;
+    term = 0;
+
+    for (line = 0; line < n_lines; line++) {
+        struct policy_action *action = &actions(p)[a];
+        uint32_t *bucket;
+
+        if (skip[line])
+            continue;
+
+        action->id = str;
+        strcpy(strings(p) + str, data[line].id);
+        str += strlen(data[line].id) + 1;
+
+        action->hash = hash_string(data[line].id);
+        action->first_group = ref;
+        action->n_groups = data[line].n_groups;
+        action->first_term = term;
+        action->n_terms = data[line].n_terms;
+        action->flags = data[line].is_list ? ACTION_FLAG_LIST : 0;
+
+        for (j = 0; j < data[line].n_groups; j++) {
+            i = find_group_name(group_names, n_groups, data[line].groups[j]);
+            group_refs(p)[ref++] = i;
+
+            if (data[line].is_list)
+                group_actions(p)[i * action_words(n_actions) + a / 32] |= 1U << (a % 32);
+        }
+
+        for (j = 0; j < data[line].n_terms; j++) {
+            struct policy_term *t = &terms(p)[term++];
+
+            t->require[0] = (uint32_t) data[line].terms[j].require;
+            t->require[1] = (uint32_t) (data[line].terms[j].require >> 32);
+            t->forbid[0] = (uint32_t) data[line].terms[j].forbid;
+            t->forbid[1] = (uint32_t) (data[line].terms[j].forbid >> 32);
+        }
+
+        /* append to the bucket chain to keep the file order */
+        bucket = &buckets(p)[action->hash & (n_buckets - 1)];
+        while (*bucket != POLICY_NONE)
+            bucket = &actions(p)[*bucket].next;
+        *bucket = a;
+        action->next = POLICY_NONE;
+
+        a++;
+    }
+
+end:
+    free(group_names);
+    free(skip);
+
+    return p;
+}
+
+struct policy *policy_load(const char *filename)
+{
+    struct line_data *data;
+    struct policy *p;
+    int n_lines = 0;
+
+    data = load_file(filename);
+    if (!data)
+        return NULL;
+
+    while (data[n_lines].id)
+        n_lines++;
+
+    p = compile(data, n_lines);
+
+    free_lines(data);
+
+    return p;
+}
+
+static uint64_t term_require(const struct policy_term *t)
+{
+    return (uint64_t) t->require[1] << 32 | t->require[0];
+}
+
+static uint64_t term_forbid(const struct policy_term *t)
+{
+    return (uint64_t) t->forbid[1] << 32 | t->forbid[0];
+}
+
+static bool valid_string(const struct policy *p, uint32_t offset)
+{
+    if (offset >= p->h.strings_size)
+        return false;
+
+    return memchr(strings(p) + offset, '\0', p->h.strings_size - offset) != NULL;
+}
+
+static bool validate(const struct policy *p, size_t size)
+{
+    uint32_t i, j, steps;
+
+    if (size < sizeof(struct policy))
+        return false;
+
+    if (p->h.magic != POLICY_MAGIC || p->h.version != POLICY_VERSION)
+        return false;
+
+    /* guard against overflows in the layout computation */
+    if (p->h.n_actions > size || p->h.n_buckets > size ||
+            p->h.n_group_refs > size || p->h.n_groups > size ||
+            p->h.n_terms > size || p->h.strings_size > size)
+        return false;
+
+    if (p->h.size != size || layout_size(p->h.n_actions, p->h.n_terms,
+            p->h.n_buckets, p->h.n_group_refs, p->h.n_groups,
+            p->h.strings_size) != size)
+        return false;
+
+    if (p->h.n_buckets == 0 || (p->h.n_buckets & (p->h.n_buckets - 1)) != 0)
+        return false;
+
+    for (i = 0; i < p->h.n_groups; i++) {
+        if (!valid_string(p, groups(p)[i]))
+            return false;
+    }
+
+    for (i = 0; i < p->h.n_group_refs; i++) {
+        if (group_refs(p)[i] >= p->h.n_groups)
+            return false;
+    }
+
+    for (i = 0; i < p->h.n_actions; i++) {
+        struct policy_action *action = &actions(p)[i];
+
+        if (!valid_string(p, action->id))
+            return false;
+
+        if (action->hash != hash_string(strings(p) + action->id))
+            return false;
+
+        if (action->first_group > p->h.n_group_refs ||
+                action->n_groups > p->h.n_group_refs - action->first_group ||
+                action->n_groups > MAX_RULE_GROUPS)
+            return false;
+
+        if (action->first_term > p->h.n_terms ||
+                action->n_terms > p->h.n_terms - action->first_term)
+            return false;
+
+        /* the terms may only refer to the groups of the rule */
+        for (j = 0; j < action->n_terms; j++) {
+            struct policy_term *t = &terms(p)[action->first_term + j];
+            uint64_t mask = action->n_groups == 64 ? 0 :
+                    ~((1ULL << action->n_groups) - 1);
+
+            if ((term_require(t) | term_forbid(t)) & mask)
+                return false;
+        }
+
+        if (action->next != POLICY_NONE && action->next >= p->h.n_actions)
+            return false;
+    }
+
+    /* every chain must end within n_actions steps */
+    for (i = 0; i < p->h.n_buckets; i++) {
+        steps = 0;
+        for (j = buckets(p)[i]; j != POLICY_NONE; j = actions(p)[j].next) {
+            if (j >= p->h.n_actions || ++steps > p->h.n_actions)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+struct policy *policy_from_blob(const void *blob, size_t size)
+{
+    struct policy *p;
+
+    /* copy first, so that the validated data can't change under us */
+    p = malloc(size);
+    if (!p)
+        return NULL;
+
+    memcpy(p, blob, size);
+
+    if (!validate(p, size)) {
+        free(p);
+        return NULL;
+    }
+
+    return p;
+}
+
+void policy_free(struct policy *p)
+{
+    free(p);
+}
+
+const void *policy_blob(const struct policy *p, size_t *size)
+{
+    *size = p->h.size;
+    return p;
+}
+
+size_t policy_strings_size(const struct policy *p)
+{
+    return p->h.strings_size;
+}
+
+uint32_t policy_n_actions(const struct policy *p)
+{
+    return p->h.n_actions;
+}
+
+const char *policy_action_id(const struct policy *p, uint32_t action)
+{
+    return strings(p) + actions(p)[action].id;
+}
+
+int policy_find_action(const struct policy *p, const char *action_id)
+{
+    uint32_t hash = hash_string(action_id);
+    uint32_t i;
+
+    for (i = buckets(p)[hash & (p->h.n_buckets - 1)]; i != POLICY_NONE;
+            i = actions(p)[i].next) {
+        if (actions(p)[i].hash == hash &&
+                strcmp(strings(p) + actions(p)[i].id, action_id) == 0)
+            return i;
+    }
+
+    return -ENOENT;
+}
+
+const uint32_t *policy_action_groups(const struct policy *p, uint32_t action,
+        uint32_t *n_groups)
+{
+    *n_groups = actions(p)[action].n_groups;
+    return group_refs(p) + actions(p)[action].first_group;
+}
+
+bool policy_action_allows(const struct policy *p, uint32_t action, uint64_t member_mask)
+{
+    const struct policy_action *a = &actions(p)[action];
+    const struct policy_term *t = terms(p) + a->first_term;
+    unsigned int allowed = 0;
+    uint32_t i;
+
+    /* All terms are evaluated without early exit, so the cost only depends
+     * on the size of the rule. The comparison compiles to a flag set, not
+     * to a branch. */
+
+    for (i = 0; i < a->n_terms; i++) {
+        uint64_t require = term_require(&t[i]);
+        uint64_t forbid = term_forbid(&t[i]);
+
+        allowed |= (((member_mask & require) ^ require) | (member_mask & forbid)) == 0;
+    }
+
+    return allowed;
+}
+
+bool policy_action_is_list(const struct policy *p, uint32_t action)
+{
+    return (actions(p)[action].flags & ACTION_FLAG_LIST) != 0;
+}
+
+uint32_t policy_action_words(const struct policy *p)
+{
+    return action_words(p->h.n_actions);
+}
+
+const uint32_t *policy_group_actions(const struct policy *p, uint32_t group)
+{
+    return group_actions(p) + group * action_words(p->h.n_actions);
+}
+
+uint32_t policy_n_groups(const struct policy *p)
+{
+    return p->h.n_groups;
+}
+
+const char *policy_group_name(const struct policy *p, uint32_t group)
+{
+    return strings(p) + groups(p)[group];
+}
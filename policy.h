@@ -0,0 +1,83 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+#ifndef GROUPCHECK_POLICY_H
+#define GROUPCHECK_POLICY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* A compiled policy is a single memory block that contains a hash index of
+ * the action ids, a table of distinct group names and the group lists of the
+ * actions. Everything inside the block is referenced by offsets, so the block
+ * can be written to a file and used again after reading it back. */
+
+struct policy;
+
+/* Resolution state of a policy group. The array of these, indexed by policy
+ * group number, is filled lazily and reset when the group database
+ * changes. */
+
+enum group_state {
+    GROUP_UNRESOLVED = 0,
+    GROUP_FOUND,
+    GROUP_MISSING,
+};
+
+struct resolved_group {
+    uint32_t state;
+    uint32_t gid;
+};
+
+struct policy *policy_load(const char *filename);
+
+/* Validate a compiled policy block and make a copy of it. */
+struct policy *policy_from_blob(const void *blob, size_t size);
+
+void policy_free(struct policy *p);
+
+const void *policy_blob(const struct policy *p, size_t *size);
+
+/* bytes of the blob taken by the action ids and group names */
+size_t policy_strings_size(const struct policy *p);
+
+uint32_t policy_n_actions(const struct policy *p);
+const char *policy_action_id(const struct policy *p, uint32_t action);
+
+/* Returns the action index, or -ENOENT if the action isn't in the policy. */
+int policy_find_action(const struct policy *p, const char *action_id);
+
+/* Returns the policy group numbers used in the rule of the action, at most
+ * 64 of them. */
+const uint32_t *policy_action_groups(const struct policy *p, uint32_t action,
+        uint32_t *n_groups);
+
+/* Evaluate the rule of the action. Bit i of member_mask tells whether the
+ * subject is in the i:th group returned by policy_action_groups(). */
+bool policy_action_allows(const struct policy *p, uint32_t action, uint64_t member_mask);
+
+/* True if the rule is a plain list of groups, any of which allows the
+ * action. Only these actions are in the policy_group_actions() bitmaps. */
+bool policy_action_is_list(const struct policy *p, uint32_t action);
+
+/* Bitmap of the plain list actions that list the policy group, with bit
+ * (a % 32) of word (a / 32) set for action a. */
+uint32_t policy_action_words(const struct policy *p);
+const uint32_t *policy_group_actions(const struct policy *p, uint32_t group);
+
+uint32_t policy_n_groups(const struct policy *p);
+const char *policy_group_name(const struct policy *p, uint32_t group);
+
+#endif /* GROUPCHECK_POLICY_H */
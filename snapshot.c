@@ -0,0 +1,328 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "snapshot.h"
+
+#define SNAPSHOT_MAGIC 0x4e534347 /* "GCSN" */
+#define SNAPSHOT_VERSION 1
+#define MAX_PATH_SIZE 256
+
+/* refuse to read anything larger than this */
+#define MAX_SNAPSHOT_SIZE (16*1024*1024)
+
+/* The header is followed by the policy block, the resolved groups (if
+ * has_groups is set) and the action request counters. The checksum covers
+ * everything after the header. */
+
+struct snapshot_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t policy_size;
+    uint32_t n_groups;
+    uint32_t n_actions;
+    uint32_t has_groups;
+    uint32_t checksum;
+    uint32_t reserved;
+    struct file_identity policy_file;
+    struct file_identity group_file;
+    char policy_path[MAX_PATH_SIZE];
+};
+
+void snapshot_file_identity(const char *path, struct file_identity *id)
+{
+    struct stat s;
+
+    memset(id, 0, sizeof(*id));
+
+    if (stat(path, &s) < 0)
+        return;
+
+    id->dev = s.st_dev;
+    id->ino = s.st_ino;
+    id->size = s.st_size;
+    id->mtime_sec = s.st_mtim.tv_sec;
+    id->mtime_nsec = s.st_mtim.tv_nsec;
+}
+
+static uint32_t checksum(const void *data, size_t size, uint32_t h)
+{
+    /* FNV-1a */
+    const unsigned char *p = data;
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 16777619U;
+    }
+
+    return h;
+}
+
+static int write_all(int fd, const void *data, size_t size)
+{
+    const char *p = data;
+    ssize_t r;
+
+    while (size > 0) {
+        r = write(fd, p, size);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        p += r;
+        size -= r;
+    }
+
+    return 0;
+}
+
+int snapshot_save_fd(int fd, const char *policy_file, const struct snapshot *s)
+{
+    struct snapshot_header h = { 0 };
+    const void *blob;
+    size_t blob_size;
+    int r;
+
+    if (strlen(policy_file) >= MAX_PATH_SIZE)
+        return -ENAMETOOLONG;
+
+    blob = policy_blob(s->policy, &blob_size);
+
+    h.magic = SNAPSHOT_MAGIC;
+    h.version = SNAPSHOT_VERSION;
+    h.policy_size = blob_size;
+    h.n_groups = policy_n_groups(s->policy);
+    h.n_actions = policy_n_actions(s->policy);
+    h.has_groups = s->groups != NULL;
+    /* The files may have changed since they were read, and then the
+     * snapshot must not pass for the new contents. */
+    h.policy_file = s->policy_file_id;
+    h.group_file = s->group_file_id;
+    strcpy(h.policy_path, policy_file);
+
+    h.checksum = checksum(blob, blob_size, 2166136261U);
+    if (s->groups)
+        h.checksum = checksum(s->groups, h.n_groups * sizeof(struct resolved_group),
+                h.checksum);
+    h.checksum = checksum(s->action_requests, h.n_actions * sizeof(uint64_t),
+            h.checksum);
+
+    r = write_all(fd, &h, sizeof(h));
+    if (r == 0)
+        r = write_all(fd, blob, blob_size);
+    if (r == 0 && s->groups)
+        r = write_all(fd, s->groups, h.n_groups * sizeof(struct resolved_group));
+    if (r == 0)
+        r = write_all(fd, s->action_requests, h.n_actions * sizeof(uint64_t));
+
+    return r;
+}
+
+int snapshot_save(const char *path, const char *policy_file,
+        const struct snapshot *s)
+{
+    char tmp_path[MAX_PATH_SIZE];
+    int fd, r;
+
+    r = snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    if (r < 0 || r >= (int) sizeof(tmp_path))
+        return -ENAMETOOLONG;
+
+    fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return -errno;
+
+    r = snapshot_save_fd(fd, policy_file, s);
+
+    if (close(fd) < 0 && r == 0)
+        r = -errno;
+
+    /* replace the old snapshot atomically */
+    if (r == 0 && rename(tmp_path, path) < 0)
+        r = -errno;
+
+    if (r < 0)
+        unlink(tmp_path);
+
+    return r;
+}
+
+static int read_fd(int fd, char **data, size_t *size)
+{
+    struct stat s;
+    char *buf;
+    size_t done = 0;
+    ssize_t r;
+
+    if (fstat(fd, &s) < 0 || s.st_size > MAX_SNAPSHOT_SIZE)
+        return -EINVAL;
+
+    buf = malloc(s.st_size + 1);
+    if (!buf)
+        return -ENOMEM;
+
+    /* read from the start, the offset may have been left anywhere */
+    while (done < (size_t) s.st_size) {
+        r = pread(fd, buf + done, s.st_size - done, done);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            break;
+        done += r;
+    }
+
+    if (done != (size_t) s.st_size) {
+        free(buf);
+        return -EIO;
+    }
+
+    *data = buf;
+    *size = done;
+
+    return 0;
+}
+
+int snapshot_load_fd(int fd, const char *policy_file,
+        const char *group_file, struct snapshot *s)
+{
+    struct snapshot_header h;
+    struct file_identity id;
+    char *data = NULL;
+    const char *payload;
+    size_t size, groups_size, requests_size;
+    int r;
+
+    memset(s, 0, sizeof(*s));
+
+    r = read_fd(fd, &data, &size);
+    if (r < 0)
+        return r;
+
+    r = -EINVAL;
+
+    if (size < sizeof(h))
+        goto fail;
+
+    memcpy(&h, data, sizeof(h));
+    payload = data + sizeof(h);
+
+    if (h.magic != SNAPSHOT_MAGIC || h.version != SNAPSHOT_VERSION)
+        goto fail;
+
+    if (h.n_groups > size || h.n_actions > size)
+        goto fail;
+
+    groups_size = h.has_groups ? h.n_groups * sizeof(struct resolved_group) : 0;
+    requests_size = h.n_actions * sizeof(uint64_t);
+
+    if (size != sizeof(h) + h.policy_size + groups_size + requests_size)
+        goto fail;
+
+    if (checksum(payload, size - sizeof(h), 2166136261U) != h.checksum)
+        goto fail;
+
+    /* the snapshot is only valid for the same, unchanged policy file */
+
+    h.policy_path[MAX_PATH_SIZE - 1] = '\0';
+    snapshot_file_identity(policy_file, &id);
+
+    if (strcmp(h.policy_path, policy_file) != 0 ||
+            memcmp(&id, &h.policy_file, sizeof(id)) != 0) {
+        r = -ESTALE;
+        goto fail;
+    }
+
+    s->policy = policy_from_blob(payload, h.policy_size);
+    if (!s->policy)
+        goto fail;
+
+    s->policy_file_id = h.policy_file;
+
+    if (policy_n_groups(s->policy) != h.n_groups ||
+            policy_n_actions(s->policy) != h.n_actions)
+        goto fail;
+
+    payload += h.policy_size;
+
+    s->action_requests = calloc(h.n_actions + 1, sizeof(uint64_t));
+    if (!s->action_requests) {
+        r = -ENOMEM;
+        goto fail;
+    }
+
+    /* resolved groups are dropped if the group database has changed */
+
+    snapshot_file_identity(group_file, &id);
+
+    if (h.has_groups && memcmp(&id, &h.group_file, sizeof(id)) == 0) {
+        uint32_t i;
+
+        s->groups = calloc(h.n_groups + 1, sizeof(struct resolved_group));
+        if (!s->groups) {
+            r = -ENOMEM;
+            goto fail;
+        }
+
+        memcpy(s->groups, payload, groups_size);
+
+        for (i = 0; i < h.n_groups; i++) {
+            if (s->groups[i].state > GROUP_MISSING)
+                s->groups[i].state = GROUP_UNRESOLVED;
+        }
+    }
+
+    payload += groups_size;
+
+    memcpy(s->action_requests, payload, requests_size);
+
+    free(data);
+
+    return 0;
+
+fail:
+    policy_free(s->policy);
+    free(s->groups);
+    free(s->action_requests);
+    memset(s, 0, sizeof(*s));
+    free(data);
+
+    return r;
+}
+
+int snapshot_load(const char *path, const char *policy_file,
+        const char *group_file, struct snapshot *s)
+{
+    int fd, r;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -errno;
+
+    r = snapshot_load_fd(fd, policy_file, group_file, s);
+
+    close(fd);
+
+    return r;
+}
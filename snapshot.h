@@ -0,0 +1,60 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+#ifndef GROUPCHECK_SNAPSHOT_H
+#define GROUPCHECK_SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "policy.h"
+
+/* The restart-safe state of the daemon: the compiled policy, the resolved
+ * policy groups and the number of requests for each action. The snapshot
+ * records the identity (device, inode, size and modification time) of the
+ * policy file and of the group database it was built from, so that it is
+ * only used while both are unchanged. */
+
+struct file_identity {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+};
+
+struct snapshot {
+    struct policy *policy;
+    /* The files that the policy and the groups were built from, as they
+     * were before they were read. Loading sets only policy_file_id. */
+    struct file_identity policy_file_id;
+    struct file_identity group_file_id;
+    /* NULL if the group database has changed since the snapshot was made */
+    struct resolved_group *groups;
+    uint64_t *action_requests;
+};
+
+/* a missing file has an all-zero identity */
+void snapshot_file_identity(const char *path, struct file_identity *id);
+
+int snapshot_save(const char *path, const char *policy_file,
+        const struct snapshot *s);
+int snapshot_save_fd(int fd, const char *policy_file, const struct snapshot *s);
+
+/* Returns -ESTALE if the policy file has changed since the snapshot. */
+int snapshot_load(const char *path, const char *policy_file,
+        const char *group_file, struct snapshot *s);
+int snapshot_load_fd(int fd, const char *policy_file,
+        const char *group_file, struct snapshot *s);
+
+#endif /* GROUPCHECK_SNAPSHOT_H */
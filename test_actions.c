@@ -0,0 +1,248 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+
+/* Checks that action texts too long for the details are cut to fit: every
+ * string is terminated inside the data, and no UTF-8 sequence is cut in
+ * half. */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "actions.h"
+
+#define TEST_BUDGET (256 * 1024)
+
+static char *repeat(const char *s, int n)
+{
+    size_t len = strlen(s);
+    char *buf = malloc(len * n + 1);
+    int i;
+
+    if (!buf)
+        return NULL;
+
+    for (i = 0; i < n; i++)
+        memcpy(buf + i * len, s, len);
+    buf[len * n] = '\0';
+
+    return buf;
+}
+
+static int write_policy(const char *dir)
+{
+    char path[256];
+    char *description, *message, *wide;
+    FILE *f;
+
+    description = repeat("d", 1500);
+    message = repeat("m", 1000);
+    /* U+00E9, two bytes in UTF-8 */
+    wide = repeat("&#233;", 1100);
+    if (!description || !message || !wide)
+        return -1;
+
+    snprintf(path, sizeof(path), "%s/org.example.policy", dir);
+    f = fopen(path, "w");
+    if (!f)
+        return -1;
+
+    fprintf(f, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<policyconfig>\n"
+            "  <vendor>Example</vendor>\n"
+            "  <action id=\"org.example.long\">\n"
+            "    <description>%s</description>\n"
+            "    <message>%s</message>\n"
+            "    <icon_name>example</icon_name>\n"
+            "    <annotate key=\"org.example.key\">value</annotate>\n"
+            "  </action>\n"
+            "  <action id=\"org.example.wide\">\n"
+            "    <description>%s</description>\n"
+            "    <message>short</message>\n"
+            "  </action>\n"
+            "</policyconfig>\n", description, message, wide);
+
+    fclose(f);
+    free(description);
+    free(message);
+    free(wide);
+
+    return 0;
+}
+
+/* the length of the string at offset, or -1 if it isn't terminated */
+static int string_len(const struct action_details *d, uint16_t offset)
+{
+    const char *nul;
+
+    if (offset >= d->data_len)
+        return -1;
+
+    nul = memchr(d->data + offset, '\0', d->data_len - offset);
+
+    return nul ? nul - (d->data + offset) : -1;
+}
+
+static bool valid_utf8(const char *s)
+{
+    const unsigned char *p = (const unsigned char *) s;
+    int follow;
+
+    while (*p) {
+        if (*p < 0x80)
+            follow = 0;
+        else if ((*p & 0xe0) == 0xc0)
+            follow = 1;
+        else if ((*p & 0xf0) == 0xe0)
+            follow = 2;
+        else if ((*p & 0xf8) == 0xf0)
+            follow = 3;
+        else
+            return false;
+
+        for (p++; follow > 0; follow--, p++) {
+            if ((*p & 0xc0) != 0x80)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static int check_string(const char *action_id, const char *what,
+        const struct action_details *d, uint16_t offset, int expected_len)
+{
+    int len = string_len(d, offset);
+
+    if (len < 0) {
+        fprintf(stderr, "%s: the %s at %u isn't terminated in %u bytes\n",
+                action_id, what, offset, d->data_len);
+        return 1;
+    }
+
+    if (expected_len >= 0 && len != expected_len) {
+        fprintf(stderr, "%s: the %s is %d bytes instead of %d\n", action_id,
+                what, len, expected_len);
+        return 1;
+    }
+
+    if (!valid_utf8(d->data + offset)) {
+        fprintf(stderr, "%s: the %s isn't valid UTF-8\n", action_id, what);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int check_details(const char *action_id, const struct action_details *d,
+        int description_len, int message_len)
+{
+    uint16_t offset;
+    int i, failures = 0;
+
+    if (d->data_len > ACTION_DETAILS_DATA_SIZE) {
+        fprintf(stderr, "%s: %u bytes of data\n", action_id, d->data_len);
+        return 1;
+    }
+
+    failures += check_string(action_id, "description", d, d->description,
+            description_len);
+    failures += check_string(action_id, "message", d, d->message, message_len);
+    failures += check_string(action_id, "vendor", d, d->vendor, -1);
+    failures += check_string(action_id, "vendor URL", d, d->vendor_url, -1);
+    failures += check_string(action_id, "icon name", d, d->icon_name, -1);
+
+    offset = d->annotations;
+    for (i = 0; i < 2 * d->n_annotations && failures == 0; i++) {
+        failures += check_string(action_id, "annotation", d, offset, -1);
+        offset += string_len(d, offset) + 1;
+    }
+
+    return failures;
+}
+
+static int check_action(struct action_index *ai, const char *action_id,
+        int description_len, int message_len)
+{
+    struct action_details d;
+    int i, r, failures = 0;
+
+    /* parsed, and then from the cache */
+    for (i = 0; i < 2; i++) {
+        memset(&d, 0xff, sizeof(d));
+
+        r = action_index_lookup(ai, action_id, "", &d);
+        if (r < 0) {
+            fprintf(stderr, "%s: lookup failed: %s\n", action_id, strerror(-r));
+            return 1;
+        }
+
+        failures += check_details(action_id, &d, description_len, message_len);
+    }
+
+    return failures;
+}
+
+int main(int argc, char *argv[])
+{
+    char dir[] = "/tmp/groupcheck-actions.XXXXXX";
+    char path[256];
+    struct cache_budget *budget;
+    struct action_index *ai;
+    int failures = 0;
+
+    if (!mkdtemp(dir))
+        return EXIT_FAILURE;
+
+    if (write_policy(dir) < 0) {
+        fprintf(stderr, "Error writing the action file.\n");
+        failures++;
+        goto end;
+    }
+
+    budget = cache_budget_new(TEST_BUDGET);
+    ai = action_index_new(dir, budget);
+    if (!budget || !ai) {
+        fprintf(stderr, "Error indexing the action file.\n");
+        failures++;
+        goto end;
+    }
+
+    /* The description fits, the message is cut to what is left, and the
+     * other strings are empty. */
+    failures += check_action(ai, "org.example.long", 1500,
+            ACTION_DETAILS_DATA_SIZE - 1501 - 1);
+
+    /* cut between two-byte characters */
+    failures += check_action(ai, "org.example.wide",
+            (ACTION_DETAILS_DATA_SIZE - 1) / 2 * 2, 0);
+
+    action_index_free(ai);
+    cache_budget_free(budget);
+
+end:
+    snprintf(path, sizeof(path), "%s/org.example.policy", dir);
+    unlink(path);
+    rmdir(dir);
+
+    if (failures > 0)
+        return EXIT_FAILURE;
+
+    fprintf(stdout, "Long action texts are cut to fit.\n");
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,211 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+
+/* Checks that answering requests doesn't allocate once the engine is warm.
+ * The subjects and groups come from the test provider, and the allocation
+ * functions are wrapped by alloc.c. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "alloc.h"
+#include "cache.h"
+#include "engine.h"
+#include "policy.h"
+#include "test_provider.h"
+
+#define N_SUBJECTS 200
+/* small enough to make the caches evict all the time */
+#define TEST_CACHE_BUDGET (8*1024)
+#define ROUNDS 20
+
+/* a user in more groups than the caches keep */
+#define BIG_USER 7
+#define BIG_USER_GIDS 100
+
+#define GID_ADM 4
+#define GID_WHEEL 10
+#define GID_GUESTS 100
+
+static const char policy_data[] =
+    "org.example.list=\"adm,wheel\"\n"
+    "org.example.expr=\"wheel&!guests\"\n"
+    "org.example.not=\"!guests\"\n"
+    "org.example.missing=\"missing\"\n";
+
+static const char *actions[] = {
+    "org.example.list",
+    "org.example.expr",
+    "org.example.not",
+    "org.example.missing",
+    "org.example.unknown",
+};
+
+static int setup_world(struct test_world *w)
+{
+    static const char *names[] = { "adm", "wheel", "guests" };
+    static const gid_t gids[] = { GID_ADM, GID_WHEEL, GID_GUESTS };
+    struct test_user *u;
+    int i, n;
+
+    memset(w, 0, sizeof(struct test_world));
+
+    for (i = 0; i < 3; i++) {
+        strcpy(w->group_names[i], names[i]);
+        w->group_gids[i] = gids[i];
+    }
+    w->n_groups = 3;
+
+    w->users = calloc(N_SUBJECTS, sizeof(struct test_user));
+    if (!w->users)
+        return -ENOMEM;
+    w->n_users = N_SUBJECTS;
+
+    for (i = 0; i < N_SUBJECTS; i++) {
+        u = &w->users[i];
+
+        u->gids = calloc(BIG_USER_GIDS, sizeof(gid_t));
+        if (!u->gids)
+            return -ENOMEM;
+
+        n = 0;
+        u->primary_gid = 1000 + i;
+        u->gids[n++] = 1000 + i;
+        if (i % 2)
+            u->gids[n++] = GID_WHEEL;
+        if (i % 3 == 0)
+            u->gids[n++] = GID_ADM;
+        if (i % 5 == 0)
+            u->gids[n++] = GID_GUESTS;
+        if (i == BIG_USER) {
+            while (n < BIG_USER_GIDS) {
+                u->gids[n] = 5000 + n;
+                n++;
+            }
+        }
+        u->n_gids = n;
+    }
+
+    return 0;
+}
+
+static void free_world(struct test_world *w)
+{
+    int i;
+
+    for (i = 0; i < w->n_users; i++)
+        free(w->users[i].gids);
+    free(w->users);
+}
+
+static int run_requests(struct engine *e, struct subject *subjects)
+{
+    const uint32_t *allowed;
+    enum validity validity;
+    int i, a, failures = 0;
+    bool expected;
+
+    for (i = 0; i < N_SUBJECTS; i++) {
+        for (a = 0; a < (int) (sizeof(actions) / sizeof(actions[0])); a++)
+            engine_check(e, &subjects[i], actions[a], &validity);
+
+        /* a sanity check of the answers */
+        expected = (i % 2) && (i % 5 != 0);
+        if (engine_check(e, &subjects[i], "org.example.expr", &validity) != expected) {
+            fprintf(stderr, "Wrong decision for subject %d\n", i);
+            failures++;
+        }
+
+        if (engine_list(e, &subjects[i], &allowed) < 0) {
+            fprintf(stderr, "Listing failed for subject %d\n", i);
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+int main(int argc, char *argv[])
+{
+    static const enum subject_kind kinds[] = {
+        SUBJECT_KIND_UNIX_PROCESS,
+        SUBJECT_KIND_SYSTEM_BUS_NAME,
+        SUBJECT_KIND_UNIX_SESSION,
+    };
+    struct subject subjects[N_SUBJECTS];
+    struct test_world world;
+    struct cache_budget *budget;
+    struct engine e;
+    struct policy *policy;
+    struct alloc_stats before, after;
+    int i, r, failures = 0;
+
+    if (setup_world(&world) < 0)
+        return EXIT_FAILURE;
+
+    budget = cache_budget_new(TEST_CACHE_BUDGET);
+    if (!budget)
+        return EXIT_FAILURE;
+
+    r = engine_init(&e, &test_provider, &world, budget);
+    if (r < 0)
+        return EXIT_FAILURE;
+
+    policy = test_load_policy(policy_data);
+    if (!policy) {
+        fprintf(stderr, "Error loading the test policy.\n");
+        return EXIT_FAILURE;
+    }
+
+    r = engine_set_policy(&e, policy, NULL, NULL);
+    if (r < 0)
+        return EXIT_FAILURE;
+
+    engine_prepare(&e);
+
+    for (i = 0; i < N_SUBJECTS; i++)
+        test_make_subject(kinds[i % 3], i, &subjects[i]);
+
+    /* warm up: slabs, hash buckets and the scratch arrays grow to size */
+    for (i = 0; i < 2; i++)
+        failures += run_requests(&e, subjects);
+
+    alloc_get_stats(&before);
+
+    for (i = 0; i < ROUNDS; i++)
+        failures += run_requests(&e, subjects);
+
+    alloc_get_stats(&after);
+
+    if (after.allocations != before.allocations) {
+        fprintf(stderr, "%llu allocations in %d warm rounds\n",
+                (unsigned long long) (after.allocations - before.allocations), ROUNDS);
+        failures++;
+    }
+
+    engine_done(&e);
+    cache_budget_free(budget);
+    free_world(&world);
+
+    if (failures > 0)
+        return EXIT_FAILURE;
+
+    fprintf(stdout, "No allocations in %d requests.\n",
+            ROUNDS * N_SUBJECTS * (int) (sizeof(actions) / sizeof(actions[0]) + 2));
+
+    return EXIT_SUCCESS;
+}
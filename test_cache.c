@@ -0,0 +1,130 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+
+/* Checks the slab size classes of the caches: typical credential and
+ * session entries land in the smallest class that holds them, every class
+ * fits at least one entry, and the slab pages are not left mostly unused. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "cache.h"
+
+#define PAGE_SIZE 4096
+/* the most that a page of any class may leave unused */
+#define MAX_PAGE_WASTE (PAGE_SIZE / 16)
+
+/* The entries of engine.c: a process is keyed by its pid and start time,
+ * and the value is the uid, the primary gid, the number of gids and the
+ * gids. A session is keyed by its id and maps to a uid. */
+#define CREDS_KEY_LEN (2 * sizeof(uint64_t))
+#define CREDS_VALUE_LEN(n_gids) (3 * sizeof(uint32_t) + (n_gids) * sizeof(gid_t))
+#define SESSION_KEY_LEN 4
+
+static int check_class(const char *what, size_t key_len, size_t value_len,
+        size_t expected)
+{
+    size_t size = cache_entry_size(key_len, value_len);
+
+    if (size != expected) {
+        fprintf(stderr, "%s is charged %zu bytes instead of %zu\n", what, size,
+                expected);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Fill slab pages of the class of the entry, and check how much of a page
+ * is left unused. */
+static int check_page_use(size_t value_len)
+{
+    struct cache_budget_stats bs;
+    struct cache_budget *budget;
+    struct cache *c;
+    unsigned char *value;
+    size_t slot = cache_entry_size(sizeof(uint32_t), value_len);
+    uint32_t key;
+    int failures = 0;
+
+    budget = cache_budget_new(4 * PAGE_SIZE);
+    c = cache_new("test", budget);
+    value = calloc(1, value_len);
+    if (!budget || !c || !value)
+        return 1;
+
+    /* the entries of the first page, which can't be more than this */
+    for (key = 0; key < PAGE_SIZE / 64; key++) {
+        cache_insert(c, &key, sizeof(key), value, value_len, 0);
+
+        cache_budget_get_stats(budget, &bs);
+        if (bs.slab_bytes > PAGE_SIZE)
+            break;
+    }
+
+    if (bs.slab_bytes != 2 * PAGE_SIZE) {
+        fprintf(stderr, "A %zu byte entry wasn't taken from a slab\n", slot);
+        failures++;
+    }
+    else if (PAGE_SIZE - key * slot > MAX_PAGE_WASTE) {
+        fprintf(stderr, "%u slots of %zu bytes leave %zu bytes of a page unused\n",
+                key, slot, PAGE_SIZE - key * slot);
+        failures++;
+    }
+
+    free(value);
+    cache_free(c);
+    cache_budget_free(budget);
+
+    return failures;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t smallest = cache_entry_size(0, 0);
+    size_t value_len;
+    int failures = 0;
+
+    /* the classes hold payloads of up to 32, 64, 128, 256 and 608 bytes */
+    failures += check_class("a 33 byte payload", 0, 33, cache_entry_size(0, 64));
+    failures += check_class("a 65 byte payload", 0, 65, cache_entry_size(0, 128));
+
+    if (cache_entry_size(0, 32) != smallest) {
+        fprintf(stderr, "A 32 byte payload doesn't fit the smallest class\n");
+        failures++;
+    }
+
+    failures += check_class("A session", SESSION_KEY_LEN, sizeof(uid_t), smallest);
+    failures += check_class("Creds with 4 gids", CREDS_KEY_LEN, CREDS_VALUE_LEN(4),
+            cache_entry_size(0, 64));
+    failures += check_class("Creds with 16 gids", CREDS_KEY_LEN, CREDS_VALUE_LEN(16),
+            cache_entry_size(0, 128));
+
+    /* the largest cached creds, 64 gids, still come from a slab */
+    failures += check_page_use(CREDS_VALUE_LEN(64));
+
+    for (value_len = 0; value_len + sizeof(uint32_t) <= 608; value_len += 8)
+        failures += check_page_use(value_len);
+
+    if (failures > 0)
+        return EXIT_FAILURE;
+
+    fprintf(stdout, "Cache entries of %zu to %zu bytes fit their slabs.\n",
+            smallest, cache_entry_size(0, 608));
+
+    return EXIT_SUCCESS;
+}
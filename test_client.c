@@ -0,0 +1,374 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+
+/* Checks how the client library follows the cacheability hints: which
+ * answers it keeps, for how long and for which bus names, and that the
+ * Changed signal, a new generation and owner changes drop them. The
+ * sd-bus calls of the library are replaced by stubs here, so that the
+ * authority is a table of canned replies and the signals are delivered by
+ * calling the match callbacks directly. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <systemd/sd-bus.h>
+
+#include "groupcheck-client.h"
+
+#define MAX_DETAILS 4
+
+/* the canned reply of the authority */
+struct authority {
+    bool allowed;
+    /* NULL leaves the hint out */
+    const char *generation;
+    const char *valid_usec;
+    const char *any_subject;
+    /* the call fails with this if not zero */
+    int error;
+    /* number of CheckAuthorization calls */
+    int calls;
+};
+
+static struct authority authority;
+
+struct sd_bus {
+    int refs;
+};
+
+struct sd_bus_slot {
+    sd_bus_message_handler_t callback;
+    void *userdata;
+};
+
+struct sd_bus_message {
+    bool allowed;
+    int n_details;
+    const char *keys[MAX_DETAILS];
+    const char *values[MAX_DETAILS];
+    /* the dict entry being read, and how deep in containers the reader is */
+    int entry;
+    int depth;
+    /* the arguments of NameOwnerChanged */
+    const char *names[3];
+};
+
+static struct sd_bus_slot *changed_slot, *owner_slot;
+
+sd_bus *sd_bus_ref(sd_bus *bus)
+{
+    bus->refs++;
+    return bus;
+}
+
+sd_bus *sd_bus_unref(sd_bus *bus)
+{
+    if (bus)
+        bus->refs--;
+    return NULL;
+}
+
+int sd_bus_add_match(sd_bus *bus, sd_bus_slot **slot, const char *match,
+        sd_bus_message_handler_t callback, void *userdata)
+{
+    struct sd_bus_slot *s;
+
+    s = calloc(1, sizeof(struct sd_bus_slot));
+    if (!s)
+        return -ENOMEM;
+
+    s->callback = callback;
+    s->userdata = userdata;
+
+    if (strstr(match, "member='Changed'"))
+        changed_slot = s;
+    else if (strstr(match, "member='NameOwnerChanged'"))
+        owner_slot = s;
+
+    *slot = s;
+    return 0;
+}
+
+sd_bus_slot *sd_bus_slot_unref(sd_bus_slot *slot)
+{
+    if (slot == changed_slot)
+        changed_slot = NULL;
+    if (slot == owner_slot)
+        owner_slot = NULL;
+
+    free(slot);
+    return NULL;
+}
+
+static void add_detail(struct sd_bus_message *m, const char *key, const char *value)
+{
+    if (!value)
+        return;
+
+    m->keys[m->n_details] = key;
+    m->values[m->n_details] = value;
+    m->n_details++;
+}
+
+int sd_bus_call_method(sd_bus *bus, const char *destination, const char *path,
+        const char *interface, const char *member, sd_bus_error *ret_error,
+        sd_bus_message **reply, const char *types, ...)
+{
+    struct sd_bus_message *m;
+
+    authority.calls++;
+
+    if (authority.error)
+        return authority.error;
+
+    m = calloc(1, sizeof(struct sd_bus_message));
+    if (!m)
+        return -ENOMEM;
+
+    m->allowed = authority.allowed;
+    add_detail(m, "groupcheck.generation", authority.generation);
+    add_detail(m, "groupcheck.valid-usec", authority.valid_usec);
+    add_detail(m, "groupcheck.any-subject", authority.any_subject);
+
+    *reply = m;
+    return 1;
+}
+
+sd_bus_message *sd_bus_message_unref(sd_bus_message *m)
+{
+    free(m);
+    return NULL;
+}
+
+int sd_bus_message_enter_container(sd_bus_message *m, char type, const char *contents)
+{
+    if (type == SD_BUS_TYPE_DICT_ENTRY && m->entry >= m->n_details)
+        return 0;
+
+    m->depth++;
+    return 1;
+}
+
+int sd_bus_message_exit_container(sd_bus_message *m)
+{
+    /* leaving a dict entry moves to the next one */
+    if (m->depth == 3)
+        m->entry++;
+
+    m->depth--;
+    return 1;
+}
+
+int sd_bus_message_read(sd_bus_message *m, const char *types, ...)
+{
+    va_list ap;
+    int i;
+
+    va_start(ap, types);
+
+    if (strcmp(types, "bb") == 0) {
+        *va_arg(ap, int *) = m->allowed;
+        *va_arg(ap, int *) = 0;
+    }
+    else if (strcmp(types, "ss") == 0) {
+        *va_arg(ap, const char **) = m->keys[m->entry];
+        *va_arg(ap, const char **) = m->values[m->entry];
+    }
+    else if (strcmp(types, "sss") == 0) {
+        for (i = 0; i < 3; i++)
+            *va_arg(ap, const char **) = m->names[i];
+    }
+
+    va_end(ap);
+
+    return 1;
+}
+
+void sd_bus_error_free(sd_bus_error *e)
+{
+}
+
+/* signals */
+
+static void emit_changed(void)
+{
+    struct sd_bus_message m = { 0 };
+
+    changed_slot->callback(&m, changed_slot->userdata, NULL);
+}
+
+static void emit_owner_changed(const char *name, const char *old_owner,
+        const char *new_owner)
+{
+    struct sd_bus_message m = { .names = { name, old_owner, new_owner } };
+
+    owner_slot->callback(&m, owner_slot->userdata, NULL);
+}
+
+/* checks */
+
+static int failures;
+
+static void set_authority(bool allowed, const char *generation,
+        const char *valid_usec, const char *any_subject)
+{
+    authority.allowed = allowed;
+    authority.generation = generation;
+    authority.valid_usec = valid_usec;
+    authority.any_subject = any_subject;
+    authority.error = 0;
+}
+
+/* check and compare the answer and whether the authority was asked */
+static void expect(int line, struct groupcheck_client *c, const char *bus_name,
+        const char *action_id, int answer, bool asked)
+{
+    int calls = authority.calls;
+    int r;
+
+    r = groupcheck_client_check(c, bus_name, action_id);
+
+    if (r != answer) {
+        fprintf(stderr, "line %d: %s %s: got %d instead of %d\n", line,
+                bus_name, action_id, r, answer);
+        failures++;
+    }
+
+    if ((authority.calls != calls) != asked) {
+        fprintf(stderr, "line %d: %s %s: the authority was %s\n", line,
+                bus_name, action_id, asked ? "not asked" : "asked");
+        failures++;
+    }
+}
+
+#define EXPECT_ASKED(c, name, action, answer) \
+    expect(__LINE__, c, name, action, answer, true)
+#define EXPECT_CACHED(c, name, action, answer) \
+    expect(__LINE__, c, name, action, answer, false)
+
+int main(int argc, char *argv[])
+{
+    struct sd_bus bus = { .refs = 1 };
+    struct groupcheck_client *c;
+    int r;
+
+    r = groupcheck_client_new(&bus, &c);
+    if (r < 0 || !changed_slot || !owner_slot) {
+        fprintf(stderr, "Error creating the client.\n");
+        return EXIT_FAILURE;
+    }
+
+    /* polkit gives no hints, so nothing is cached */
+    set_authority(true, NULL, NULL, NULL);
+    EXPECT_ASKED(c, ":1.1", "org.example.a", 1);
+    EXPECT_ASKED(c, ":1.1", "org.example.a", 1);
+
+    /* neither is a decision that shouldn't be reused */
+    set_authority(true, "g1", "0", NULL);
+    EXPECT_ASKED(c, ":1.1", "org.example.a", 1);
+    EXPECT_ASKED(c, ":1.1", "org.example.a", 1);
+
+    /* valid for as long as the bus name exists, and only for it */
+    set_authority(true, "g1", "infinity", NULL);
+    EXPECT_ASKED(c, ":1.1", "org.example.a", 1);
+    set_authority(false, "g1", "infinity", NULL);
+    EXPECT_CACHED(c, ":1.1", "org.example.a", 1);
+    EXPECT_ASKED(c, ":1.2", "org.example.a", 0);
+    EXPECT_CACHED(c, ":1.2", "org.example.a", 0);
+    EXPECT_ASKED(c, ":1.1", "org.example.b", 0);
+
+    /* a bus name that went away loses its entries */
+    emit_owner_changed(":1.1", ":1.1", "");
+    set_authority(true, "g1", "infinity", NULL);
+    EXPECT_ASKED(c, ":1.1", "org.example.a", 1);
+    EXPECT_CACHED(c, ":1.2", "org.example.a", 0);
+
+    /* a well-known name changing owners doesn't matter */
+    emit_owner_changed("org.example.Service", ":1.3", ":1.4");
+    EXPECT_CACHED(c, ":1.1", "org.example.a", 1);
+
+    /* the Changed signal drops everything */
+    emit_changed();
+    set_authority(false, "g1", "infinity", NULL);
+    EXPECT_ASKED(c, ":1.1", "org.example.a", 0);
+    EXPECT_CACHED(c, ":1.1", "org.example.a", 0);
+
+    /* so does a new owner of the authority */
+    emit_owner_changed("org.freedesktop.PolicyKit1", ":1.10", ":1.11");
+    set_authority(true, "g1", "infinity", NULL);
+    EXPECT_ASKED(c, ":1.1", "org.example.a", 1);
+
+    /* an answer from another generation makes the others stale */
+    set_authority(true, "g1", "infinity", NULL);
+    EXPECT_ASKED(c, ":1.2", "org.example.b", 1);
+    set_authority(false, "g2", "infinity", NULL);
+    EXPECT_ASKED(c, ":1.2", "org.example.c", 0);
+    EXPECT_ASKED(c, ":1.1", "org.example.a", 0);
+    EXPECT_ASKED(c, ":1.2", "org.example.b", 0);
+    EXPECT_CACHED(c, ":1.2", "org.example.c", 0);
+
+    /* decisions that are the same for every subject */
+    emit_changed();
+    set_authority(true, "g2", "infinity", "1");
+    EXPECT_ASKED(c, ":1.5", "org.example.any", 1);
+    EXPECT_CACHED(c, ":1.6", "org.example.any", 1);
+    EXPECT_CACHED(c, ":1.7", "org.example.any", 1);
+
+    /* decisions that expire */
+    emit_changed();
+    set_authority(true, "g2", "20000", NULL);
+    EXPECT_ASKED(c, ":1.1", "org.example.a", 1);
+    EXPECT_CACHED(c, ":1.1", "org.example.a", 1);
+    usleep(40000);
+    EXPECT_ASKED(c, ":1.1", "org.example.a", 1);
+
+    /* hints that can't be parsed aren't followed */
+    emit_changed();
+    set_authority(true, "g2", "soon", NULL);
+    EXPECT_ASKED(c, ":1.1", "org.example.a", 1);
+    EXPECT_ASKED(c, ":1.1", "org.example.a", 1);
+
+    /* errors are passed on and not cached */
+    emit_changed();
+    set_authority(true, "g2", "infinity", NULL);
+    authority.error = -ECONNREFUSED;
+    EXPECT_ASKED(c, ":1.1", "org.example.a", -ECONNREFUSED);
+    authority.error = 0;
+    EXPECT_ASKED(c, ":1.1", "org.example.a", 1);
+
+    groupcheck_client_free(c);
+
+    if (bus.refs != 1) {
+        fprintf(stderr, "The client left %d references to the bus.\n", bus.refs - 1);
+        failures++;
+    }
+
+    if (changed_slot || owner_slot) {
+        fprintf(stderr, "The client didn't remove its matches.\n");
+        failures++;
+    }
+
+    if (failures > 0)
+        return EXIT_FAILURE;
+
+    fprintf(stdout, "The client followed the hints in %d calls.\n", authority.calls);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,338 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+
+/* Loads reference policies, runs requests against them and compares the
+ * memory that groupcheck holds with the baselines in
+ * test_footprint.baseline. A component footprint or a resident memory
+ * growth over the baseline fails the test. After an intended change,
+ * update the baselines from the output of the test. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "cache.h"
+#include "engine.h"
+#include "policy.h"
+#include "test_provider.h"
+
+#define BASELINE_FILE "test_footprint.baseline"
+
+/* the default of the daemon */
+#define TEST_CACHE_BUDGET (128*1024)
+
+#define N_USERS 500
+#define N_TEST_GROUPS 64
+#define LARGE_ACTIONS 1000
+
+struct reference {
+    const char *name;
+    size_t footprint_bytes;
+    size_t resident_bytes;
+};
+
+static size_t resident_bytes(void)
+{
+    char buf[64];
+    unsigned long size, resident;
+    ssize_t len;
+    int fd;
+
+    fd = open("/proc/self/statm", O_RDONLY|O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+
+    len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0)
+        return 0;
+
+    buf[len] = '\0';
+    if (sscanf(buf, "%lu %lu", &size, &resident) != 2)
+        return 0;
+
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+static char *read_file(const char *path)
+{
+    char *data;
+    long size;
+    FILE *f;
+
+    f = fopen(path, "re");
+    if (!f)
+        return NULL;
+
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+
+    data = calloc(1, size + 1);
+    if (data && fread(data, 1, size, f) != (size_t) size) {
+        free(data);
+        data = NULL;
+    }
+
+    fclose(f);
+    return data;
+}
+
+static char *large_policy(void)
+{
+    size_t size = LARGE_ACTIONS * 128, len = 0;
+    char *data;
+    int a;
+
+    data = malloc(size);
+    if (!data)
+        return NULL;
+
+    /* mostly plain lists, like real policies, and some expressions */
+    for (a = 0; a < LARGE_ACTIONS; a++) {
+        int g = a % N_TEST_GROUPS, h = (a * 7 + 3) % N_TEST_GROUPS;
+
+        if (a % 10 == 0)
+            len += snprintf(data + len, size - len,
+                    "org.example.component%d.action%d=\"g%d&!g%d\"\n", a / 20, a, g, h);
+        else
+            len += snprintf(data + len, size - len,
+                    "org.example.component%d.action%d=\"g%d,g%d,adm\"\n", a / 20, a, g, h);
+    }
+
+    return data;
+}
+
+static int setup_world(struct test_world *w)
+{
+    int i, j;
+
+    memset(w, 0, sizeof(struct test_world));
+
+    for (i = 0; i < N_TEST_GROUPS; i++) {
+        snprintf(w->group_names[i], TEST_GROUP_NAME_SIZE, "g%d", i);
+        w->group_gids[i] = 2000 + i;
+    }
+    strcpy(w->group_names[i], "adm");
+    w->group_gids[i] = 4;
+    strcpy(w->group_names[i + 1], "wheel");
+    w->group_gids[i + 1] = 10;
+    w->n_groups = N_TEST_GROUPS + 2;
+
+    w->users = calloc(N_USERS, sizeof(struct test_user));
+    if (!w->users)
+        return -ENOMEM;
+    w->n_users = N_USERS;
+
+    for (i = 0; i < N_USERS; i++) {
+        struct test_user *u = &w->users[i];
+
+        u->gids = calloc(8, sizeof(gid_t));
+        if (!u->gids)
+            return -ENOMEM;
+
+        u->primary_gid = 1000 + i;
+        u->gids[0] = 1000 + i;
+        for (j = 1; j < 8; j++)
+            u->gids[j] = 2000 + (i * j) % (N_TEST_GROUPS + 8);
+        u->n_gids = 8;
+    }
+
+    return 0;
+}
+
+static void free_world(struct test_world *w)
+{
+    int i;
+
+    for (i = 0; i < w->n_users; i++)
+        free(w->users[i].gids);
+    free(w->users);
+}
+
+/* Returns the footprint of the components, and the growth of the
+ * resident memory in resident. */
+static int measure(const char *data, struct test_world *w, size_t *footprint,
+        size_t *resident)
+{
+    static const enum subject_kind kinds[] = {
+        SUBJECT_KIND_UNIX_PROCESS,
+        SUBJECT_KIND_SYSTEM_BUS_NAME,
+        SUBJECT_KIND_UNIX_SESSION,
+    };
+    struct engine_footprint fp;
+    struct cache_budget_stats bs;
+    struct cache_budget *budget;
+    struct policy *policy;
+    struct subject subject;
+    const uint32_t *allowed;
+    enum validity validity;
+    struct engine e;
+    size_t before;
+    uint32_t a, n_actions;
+    int i, r;
+
+    before = resident_bytes();
+
+    budget = cache_budget_new(TEST_CACHE_BUDGET);
+    if (!budget)
+        return -ENOMEM;
+
+    r = engine_init(&e, &test_provider, w, budget);
+    if (r < 0)
+        goto end;
+
+    policy = test_load_policy(data);
+    if (!policy) {
+        r = -EINVAL;
+        goto end;
+    }
+
+    r = engine_set_policy(&e, policy, NULL, NULL);
+    if (r < 0)
+        goto end;
+
+    engine_prepare(&e);
+
+    n_actions = policy_n_actions(e.policy);
+
+    for (i = 0; i < N_USERS; i++) {
+        test_make_subject(kinds[i % 3], i, &subject);
+
+        for (a = i % 7; a < n_actions; a += 7)
+            engine_check(&e, &subject, policy_action_id(e.policy, a), &validity);
+
+        engine_list(&e, &subject, &allowed);
+    }
+
+    engine_get_footprint(&e, &fp);
+    cache_budget_get_stats(budget, &bs);
+
+    *footprint = fp.policy_bytes + fp.state_bytes + fp.gid_index_bytes
+            + fp.scratch_bytes + bs.slab_bytes;
+
+    for (i = 0; i < N_CACHES; i++) {
+        struct cache_stats cs;
+
+        cache_get_stats(e.caches[i], &cs);
+        *footprint += cs.index_bytes;
+    }
+
+    *resident = resident_bytes() - before;
+
+end:
+    engine_done(&e);
+    cache_budget_free(budget);
+    return r;
+}
+
+static int load_baselines(const char *path, struct reference *refs, int n_refs)
+{
+    char line[256], name[64];
+    unsigned long footprint, resident;
+    FILE *f;
+    int i, found = 0;
+
+    f = fopen(path, "re");
+    if (!f)
+        return -errno;
+
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+
+        if (sscanf(line, "%63s %lu %lu", name, &footprint, &resident) != 3)
+            continue;
+
+        for (i = 0; i < n_refs; i++) {
+            if (strcmp(refs[i].name, name) == 0) {
+                refs[i].footprint_bytes = footprint;
+                refs[i].resident_bytes = resident;
+                found++;
+            }
+        }
+    }
+
+    fclose(f);
+
+    return found == n_refs ? 0 : -ENOENT;
+}
+
+int main(int argc, char *argv[])
+{
+    struct reference refs[] = {
+        { .name = "default" },
+        { .name = "large" },
+    };
+    const char *srcdir = getenv("srcdir");
+    char path[1024];
+    char *data[2];
+    struct test_world world;
+    size_t footprint, resident;
+    int i, r, failures = 0;
+
+    if (!srcdir)
+        srcdir = ".";
+
+    snprintf(path, sizeof(path), "%s/%s", srcdir, BASELINE_FILE);
+    r = load_baselines(path, refs, 2);
+    if (r < 0) {
+        fprintf(stderr, "Error reading %s: %s\n", path, strerror(-r));
+        return EXIT_FAILURE;
+    }
+
+    snprintf(path, sizeof(path), "%s/groupcheck.policy", srcdir);
+    data[0] = read_file(path);
+    data[1] = large_policy();
+    if (!data[0] || !data[1]) {
+        fprintf(stderr, "Error reading the reference policies.\n");
+        return EXIT_FAILURE;
+    }
+
+    if (setup_world(&world) < 0)
+        return EXIT_FAILURE;
+
+    for (i = 0; i < 2; i++) {
+        r = measure(data[i], &world, &footprint, &resident);
+        if (r < 0) {
+            fprintf(stderr, "Error measuring policy %s: %s\n", refs[i].name,
+                    strerror(-r));
+            return EXIT_FAILURE;
+        }
+
+        fprintf(stdout, "%s %zu %zu\n", refs[i].name, footprint, resident);
+
+        if (footprint > refs[i].footprint_bytes) {
+            fprintf(stderr, "Policy %s: footprint %zu bytes, baseline %zu\n",
+                    refs[i].name, footprint, refs[i].footprint_bytes);
+            failures++;
+        }
+
+        if (resident > refs[i].resident_bytes) {
+            fprintf(stderr, "Policy %s: resident memory grew by %zu bytes, baseline %zu\n",
+                    refs[i].name, resident, refs[i].resident_bytes);
+            failures++;
+        }
+    }
+
+    free_world(&world);
+    free(data[0]);
+    free(data[1]);
+
+    return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+
+/* Checks the guarantees of the heavy hitter summaries on a skewed stream:
+ * every key with more than total / capacity of the weight is found, and
+ * the reported weights bound the real ones from above by at most the
+ * error. Merged summaries have to keep the same guarantees. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "heavy.h"
+
+#define CAPACITY 16
+#define N_KEYS 1000
+#define N_EVENTS 100000
+
+/* the share of the stream that goes to the first keys, in percent */
+static const int heavy_percent[] = { 30, 15, 8 };
+#define N_HEAVY_KEYS (sizeof(heavy_percent) / sizeof(heavy_percent[0]))
+
+static uint64_t counts[N_KEYS];
+
+static int pick_key(unsigned int *seed)
+{
+    int p = rand_r(seed) % 100;
+    unsigned int i;
+
+    for (i = 0; i < N_HEAVY_KEYS; i++) {
+        if (p < heavy_percent[i])
+            return i;
+        p -= heavy_percent[i];
+    }
+
+    /* the rest is noise over all the other keys */
+    return N_HEAVY_KEYS + rand_r(seed) % (N_KEYS - N_HEAVY_KEYS);
+}
+
+static int check_summary(const char *name, struct heavy_hitters *h, uint64_t total)
+{
+    struct heavy_entry top[CAPACITY];
+    unsigned int n, i, k;
+    int failures = 0;
+
+    if (heavy_hitters_total(h) != total) {
+        fprintf(stderr, "%s: total %llu, expected %llu\n", name,
+                (unsigned long long) heavy_hitters_total(h), (unsigned long long) total);
+        failures++;
+    }
+
+    n = heavy_hitters_top(h, top, CAPACITY);
+
+    for (i = 0; i < n; i++) {
+        k = atoi(top[i].key + 1);
+
+        if (top[i].weight < counts[k] || top[i].weight - top[i].error > counts[k]) {
+            fprintf(stderr, "%s: %s has weight %llu, error %llu, real %llu\n", name,
+                    top[i].key, (unsigned long long) top[i].weight,
+                    (unsigned long long) top[i].error, (unsigned long long) counts[k]);
+            failures++;
+        }
+
+        if (i > 0 && top[i].weight > top[i - 1].weight) {
+            fprintf(stderr, "%s: entries out of order\n", name);
+            failures++;
+        }
+    }
+
+    /* the heavy keys come first, in their order */
+    for (i = 0; i < N_HEAVY_KEYS; i++) {
+        char key[HEAVY_KEY_SIZE];
+
+        snprintf(key, sizeof(key), "k%u", i);
+        if (i >= n || strcmp(top[i].key, key) != 0) {
+            fprintf(stderr, "%s: %s is not at place %u\n", name, key, i + 1);
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+int main(int argc, char *argv[])
+{
+    struct heavy_hitters *all, *first, *second;
+    struct heavy_entry top[1];
+    unsigned int seed = 1;
+    char key[HEAVY_KEY_SIZE];
+    int i, k, failures = 0;
+
+    all = heavy_hitters_new(CAPACITY);
+    first = heavy_hitters_new(CAPACITY);
+    second = heavy_hitters_new(CAPACITY);
+    if (!all || !first || !second)
+        return EXIT_FAILURE;
+
+    for (i = 0; i < N_EVENTS; i++) {
+        k = pick_key(&seed);
+        counts[k]++;
+
+        snprintf(key, sizeof(key), "k%d", k);
+        heavy_hitters_add(all, key, 1);
+
+        /* the same stream split in two, like between worker threads */
+        heavy_hitters_add(i % 2 ? first : second, key, 1);
+    }
+
+    failures += check_summary("single", all, N_EVENTS);
+
+    heavy_hitters_merge(first, second);
+    failures += check_summary("merged", first, N_EVENTS);
+
+    if (heavy_hitters_total(second) != 0 || heavy_hitters_top(second, top, 1) != 0) {
+        fprintf(stderr, "merged summary was not reset\n");
+        failures++;
+    }
+
+    heavy_hitters_decay(all);
+    if (heavy_hitters_top(all, top, 1) != 1 || top[0].weight > (counts[0] + CAPACITY) / 2 ||
+            heavy_hitters_total(all) != N_EVENTS / 2) {
+        fprintf(stderr, "decay didn't halve the weights\n");
+        failures++;
+    }
+
+    heavy_hitters_free(all);
+    heavy_hitters_free(first);
+    heavy_hitters_free(second);
+
+    if (failures > 0)
+        return EXIT_FAILURE;
+
+    fprintf(stdout, "Heavy hitters found in %d events over %d keys.\n", N_EVENTS, N_KEYS);
+
+    return EXIT_SUCCESS;
+}
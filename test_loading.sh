@@ -0,0 +1,118 @@
+#!/bin/sh
+#
+# groupcheck is a minimal polkit replacement for group-based authentication.
+# Copyright (c) 2016, Intel Corporation.
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms and conditions of the GNU Lesser General Public License,
+# version 2.1, as published by the Free Software Foundation.
+#
+# This program is distributed in the hope it will be useful, but WITHOUT ANY
+# WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+# FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+# more details.
+
+# Calls GetStatistics while the policy is loading. groupcheck runs on a
+# bus of its own, and its policy file is a FIFO, so that the loader thread
+# waits in the middle of loading until the test writes the policy. Until
+# then only the counters that don't depend on the loaded state may be
+# reported.
+
+if ! command -v dbus-daemon >/dev/null || ! command -v busctl >/dev/null; then
+    echo "dbus-daemon or busctl is missing, skipping."
+    exit 77
+fi
+
+dir=$(mktemp -d)
+address="unix:path=$dir/bus"
+bus_pid=
+groupcheck_pid=
+
+cleanup() {
+    # SIGKILL, so that groupcheck doesn't save a snapshot of the test policy
+    [ -n "$groupcheck_pid" ] && kill -KILL "$groupcheck_pid" 2>/dev/null
+    [ -n "$bus_pid" ] && kill "$bus_pid" 2>/dev/null
+    rm -rf "$dir"
+}
+trap cleanup EXIT
+
+fail() {
+    echo "$1"
+    [ -f "$dir/log" ] && cat "$dir/log"
+    exit 1
+}
+
+cat > "$dir/bus.conf" <<CONF
+<!DOCTYPE busconfig PUBLIC "-//freedesktop//DTD D-Bus Bus Configuration 1.0//EN"
+ "http://www.freedesktop.org/standards/dbus/1.0/busconfig.dtd">
+<busconfig>
+  <type>system</type>
+  <listen>$address</listen>
+  <auth>EXTERNAL</auth>
+  <policy context="default">
+    <allow user="*"/>
+    <allow own="*"/>
+    <allow send_destination="*"/>
+    <allow receive_sender="*"/>
+  </policy>
+</busconfig>
+CONF
+
+bus_pid=$(dbus-daemon --config-file="$dir/bus.conf" --fork --print-pid) ||
+    fail "Error starting dbus-daemon."
+
+mkfifo "$dir/policy" || fail "Error creating FIFO."
+
+DBUS_SYSTEM_BUS_ADDRESS="$address" ./groupcheck --policy="$dir/policy" \
+    > "$dir/log" 2>&1 &
+groupcheck_pid=$!
+
+statistics() {
+    busctl --address="$address" call org.freedesktop.PolicyKit1 \
+        /org/freedesktop/PolicyKit1/Authority \
+        org.groupcheck.Statistics1 GetStatistics
+}
+
+# the name is claimed before the policy is loaded
+i=0
+until busctl --address="$address" call org.freedesktop.DBus \
+        /org/freedesktop/DBus org.freedesktop.DBus NameHasOwner s \
+        org.freedesktop.PolicyKit1 2>/dev/null | grep -q true; do
+    i=$((i + 1))
+    [ $i -gt 100 ] && fail "groupcheck didn't claim its name."
+    sleep 0.1
+done
+
+stats=$(statistics) || fail "GetStatistics failed while loading."
+
+echo "$stats" | grep -q '"requests.queued"' ||
+    fail "No request counters while loading: $stats"
+
+for key in policy.actions memory.policy-bytes memory.gid-index-bytes \
+        memory.action-index-bytes action-details.entries; do
+    echo "$stats" | grep -q "\"$key\"" &&
+        fail "$key reported while loading: $stats"
+done
+
+# Let the loader go on. Opening the FIFO for reading and writing doesn't
+# block even if groupcheck has died.
+exec 3<>"$dir/policy"
+echo 'org.example.test="adm"' >&3
+exec 3>&-
+
+i=0
+until statistics | grep -q '"policy.actions" 1'; do
+    i=$((i + 1))
+    [ $i -gt 100 ] && fail "groupcheck didn't finish loading."
+    sleep 0.1
+done
+
+stats=$(statistics) || fail "GetStatistics failed after loading."
+
+for key in memory.policy-bytes memory.gid-index-bytes memory.action-index-bytes; do
+    echo "$stats" | grep -q "\"$key\"" ||
+        fail "$key missing after loading: $stats"
+done
+
+echo "GetStatistics answered while loading and after it."
+exit 0
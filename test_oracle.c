@@ -0,0 +1,691 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+
+/* A differential test of the decision engine. The reference is the plain
+ * evaluator that groupcheck started with: find the first policy line of the
+ * action with strcmp(), get the credentials of the subject, look up every
+ * group of the rule by name and check the supplementary gids. It is
+ * extended here to the boolean rules, but it shares no code with policy.c
+ * or engine.c.
+ *
+ * Random policies, group databases and subjects are fed to both through
+ * the test provider, and every engine_check() and engine_list() answer is
+ * compared with the reference. The number of comparisons and the random
+ * seed can be given on the command line:
+ *
+ *     ./test_oracle [COMPARISONS [SEED]]
+ *
+ * The time spent by both sides is reported as a speedup, also next to a
+ * mismatch. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include "cache.h"
+#include "engine.h"
+#include "policy.h"
+#include "test_provider.h"
+
+#define DEFAULT_COMPARISONS 1000000ULL
+#define DEFAULT_SEED 1
+
+#define N_NAMES 24
+#define MAX_GID 40
+#define N_USERS 48
+#define N_SUBJECTS 64
+#define MAX_ACTIONS 40
+/* group database changes between the batches of a policy */
+#define BATCHES 4
+/* users in more groups than fit in the scratch space at first */
+#define BIG_USER_GIDS 100
+
+#define MAX_EXPR_SIZE 256
+#define POLICY_SIZE (MAX_ACTIONS * (MAX_EXPR_SIZE + 64))
+
+#define MAX_MISMATCHES 10
+
+struct oracle_line {
+    char id[64];
+    char expr[MAX_EXPR_SIZE];
+};
+
+struct oracle {
+    struct test_world *world;
+    int n_lines;
+    struct oracle_line lines[MAX_ACTIONS];
+    gid_t gids[BIG_USER_GIDS];
+};
+
+struct expr_eval {
+    struct oracle *o;
+    const char *p;
+    gid_t primary_gid;
+    const gid_t *gids;
+    int n_gids;
+};
+
+static uint64_t rng_state;
+
+static uint32_t rnd(uint32_t n)
+{
+    /* xorshift64* */
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+
+    return (uint32_t) ((rng_state * 2685821657736338717ULL) >> 32) % n;
+}
+
+static uint64_t now_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* the reference */
+
+static bool eval_or(struct expr_eval *ev);
+
+static bool eval_group(struct expr_eval *ev)
+{
+    char name[MAX_EXPR_SIZE];
+    size_t len = 0;
+    gid_t gid;
+    int i;
+
+    while (*ev->p && strchr(",|&!()\"", *ev->p) == NULL)
+        name[len++] = *ev->p++;
+    name[len] = '\0';
+
+    if (test_provider.group_gid(ev->o->world, name, &gid) < 0)
+        return false;
+
+    for (i = 0; i < ev->n_gids; i++) {
+        /* only the supplementary gids count */
+        if (ev->gids[i] != ev->primary_gid && ev->gids[i] == gid)
+            return true;
+    }
+
+    return false;
+}
+
+static bool eval_unary(struct expr_eval *ev)
+{
+    bool value;
+
+    if (*ev->p == '!') {
+        ev->p++;
+        return !eval_unary(ev);
+    }
+
+    if (*ev->p == '(') {
+        ev->p++;
+        value = eval_or(ev);
+        /* the closing parenthesis */
+        ev->p++;
+        return value;
+    }
+
+    return eval_group(ev);
+}
+
+static bool eval_and(struct expr_eval *ev)
+{
+    bool value = eval_unary(ev);
+
+    while (*ev->p == '&') {
+        ev->p++;
+        /* evaluate both sides, so that the whole expression is parsed */
+        value = eval_unary(ev) && value;
+    }
+
+    return value;
+}
+
+static bool eval_or(struct expr_eval *ev)
+{
+    bool value = eval_and(ev);
+
+    while (*ev->p == ',' || *ev->p == '|') {
+        ev->p++;
+        value = eval_and(ev) || value;
+    }
+
+    return value;
+}
+
+static int oracle_creds(struct oracle *o, const struct subject *subject,
+        struct engine_creds *creds)
+{
+    uint64_t start_time;
+    uid_t uid;
+    int r;
+
+    creds->gids = o->gids;
+    creds->max_gids = BIG_USER_GIDS;
+
+    switch (subject->kind) {
+    case SUBJECT_KIND_UNIX_PROCESS:
+        /* no start time: whatever the process has now */
+        start_time = subject->data.p.start_time;
+        if (start_time == 0) {
+            r = test_provider.process_start_time(o->world, subject->data.p.pid,
+                    &start_time);
+            if (r < 0)
+                return r;
+        }
+        return test_provider.process_creds(o->world, subject->data.p.pid,
+                start_time, creds);
+    case SUBJECT_KIND_SYSTEM_BUS_NAME:
+        return test_provider.bus_name_creds(o->world,
+                subject->data.b.system_bus_name, creds);
+    case SUBJECT_KIND_UNIX_SESSION:
+        r = test_provider.session_uid(o->world, subject->data.s.session_id, &uid);
+        if (r < 0)
+            return r;
+        return test_provider.user_groups(o->world, uid, creds);
+    default:
+        return -EINVAL;
+    }
+}
+
+static bool oracle_check(struct oracle *o, const struct subject *subject,
+        const char *action_id)
+{
+    struct engine_creds creds;
+    struct expr_eval ev = { .o = o };
+    int i;
+
+    for (i = 0; i < o->n_lines; i++) {
+        if (strcmp(o->lines[i].id, action_id) == 0)
+            break;
+    }
+
+    if (i == o->n_lines)
+        return false;
+
+    /* an empty rule allows nobody */
+    if (o->lines[i].expr[0] == '\0')
+        return false;
+
+    if (oracle_creds(o, subject, &creds) < 0)
+        return false;
+
+    if (creds.n_gids > creds.max_gids)
+        return false;
+
+    ev.p = o->lines[i].expr;
+    ev.primary_gid = creds.primary_gid;
+    ev.gids = creds.gids;
+    ev.n_gids = creds.n_gids;
+
+    return eval_or(&ev);
+}
+
+/* random input */
+
+static void random_name(char *buf, bool may_be_empty)
+{
+    /* an empty name is a group that nobody is in */
+    if (may_be_empty && rnd(32) == 0)
+        buf[0] = '\0';
+    else
+        sprintf(buf, "g%u", rnd(N_NAMES));
+}
+
+/* Small enough expressions that their normal form never exceeds the
+ * limits of the compiler. A name may be empty only if it is a whole list
+ * entry, which is when the list separators or the ends of a rule or
+ * parentheses are on both sides of it. */
+static void random_expr(char *buf, int depth, int *leaves, bool left_entry,
+        bool right_entry)
+{
+    static const char *or_ops[] = { ",", "|" };
+    int op = depth > 0 && *leaves < 5 ? rnd(5) : 0;
+    char left[MAX_EXPR_SIZE], right[MAX_EXPR_SIZE];
+
+    switch (op) {
+    case 1:
+        random_expr(left, depth - 1, leaves, false, right_entry);
+        sprintf(buf, "!%s", left);
+        break;
+    case 2:
+        random_expr(left, depth - 1, leaves, true, true);
+        /* but not "()" */
+        if (left[0] == '\0')
+            random_name(left, false);
+        sprintf(buf, "(%s)", left);
+        break;
+    case 3:
+        random_expr(left, depth - 1, leaves, left_entry, false);
+        random_expr(right, depth - 1, leaves, false, right_entry);
+        sprintf(buf, "%s&%s", left, right);
+        break;
+    case 4:
+        random_expr(left, depth - 1, leaves, left_entry, true);
+        random_expr(right, depth - 1, leaves, true, right_entry);
+        sprintf(buf, "%s%s%s", left, or_ops[rnd(2)], right);
+        break;
+    default:
+        random_name(buf, left_entry && right_entry);
+        (*leaves)++;
+        break;
+    }
+}
+
+static void random_rule(char *buf)
+{
+    int i, n, leaves = 0;
+
+    switch (rnd(8)) {
+    case 0:
+        /* nobody */
+        buf[0] = '\0';
+        break;
+    case 1:
+    case 2:
+        /* a plain list */
+        n = 1 + rnd(4);
+        buf[0] = '\0';
+        for (i = 0; i < n; i++) {
+            if (i > 0)
+                strcat(buf, ",");
+            random_name(buf + strlen(buf), true);
+        }
+        break;
+    default:
+        random_expr(buf, 3, &leaves, true, true);
+        break;
+    }
+}
+
+static void random_policy(struct oracle *o, char *data)
+{
+    struct oracle_line *line;
+    int i;
+
+    o->n_lines = 1 + rnd(MAX_ACTIONS);
+    data[0] = '\0';
+
+    for (i = 0; i < o->n_lines; i++) {
+        line = &o->lines[i];
+
+        /* some actions are listed twice, and the first line counts */
+        sprintf(line->id, "org.example.a%u", rnd(MAX_ACTIONS + MAX_ACTIONS / 4));
+        random_rule(line->expr);
+
+        if (rnd(4) == 0)
+            strcat(data, "# a comment\n");
+        sprintf(data + strlen(data), "%s=\"%s\"\n", line->id, line->expr);
+    }
+}
+
+static void random_groups(struct test_world *w)
+{
+    int i;
+
+    /* some names are missing, and some share a gid */
+    w->n_groups = 0;
+    for (i = 0; i < N_NAMES; i++) {
+        if (rnd(5) == 0)
+            continue;
+
+        sprintf(w->group_names[w->n_groups], "g%d", i);
+        w->group_gids[w->n_groups] = 1 + rnd(MAX_GID);
+        w->n_groups++;
+    }
+}
+
+static void random_users(struct test_world *w)
+{
+    struct test_user *u;
+    int i, n;
+
+    for (i = 0; i < w->n_users; i++) {
+        u = &w->users[i];
+
+        u->primary_gid = 1 + rnd(MAX_GID);
+        n = rnd(10) == 0 ? 65 + rnd(BIG_USER_GIDS - 65) : rnd(8);
+
+        for (u->n_gids = 0; u->n_gids < n; u->n_gids++) {
+            /* usually the primary gid is in the list too */
+            if (u->n_gids == 0 && rnd(4) != 0)
+                u->gids[u->n_gids] = u->primary_gid;
+            else
+                u->gids[u->n_gids] = 1 + rnd(MAX_GID);
+        }
+    }
+}
+
+static void random_subject(struct subject *subject)
+{
+    static const enum subject_kind kinds[] = {
+        SUBJECT_KIND_UNIX_PROCESS,
+        SUBJECT_KIND_SYSTEM_BUS_NAME,
+        SUBJECT_KIND_UNIX_SESSION,
+    };
+    /* a few subjects are unknown users */
+    uint32_t uid = rnd(N_USERS + 4);
+
+    test_make_subject(kinds[rnd(3)], uid, subject);
+
+    if (rnd(16) != 0)
+        return;
+
+    switch (subject->kind) {
+    case SUBJECT_KIND_UNIX_PROCESS:
+        /* a process that has been replaced, or one that gives no start
+         * time */
+        if (rnd(2))
+            subject->data.p.start_time++;
+        else
+            subject->data.p.start_time = 0;
+        break;
+    case SUBJECT_KIND_SYSTEM_BUS_NAME:
+        strcpy(subject->data.b.system_bus_name, "org.example.NotUnique");
+        break;
+    default:
+        subject->kind = SUBJECT_KIND_UNKNOWN;
+        break;
+    }
+}
+
+/* running */
+
+struct stats {
+    uint64_t comparisons;
+    uint64_t mismatches;
+    uint64_t engine_nsec;
+    uint64_t oracle_nsec;
+};
+
+static double speedup(const struct stats *s)
+{
+    return s->engine_nsec ? (double) s->oracle_nsec / s->engine_nsec : 0.0;
+}
+
+static void describe_subject(const struct subject *subject, char *buf, size_t size)
+{
+    switch (subject->kind) {
+    case SUBJECT_KIND_UNIX_PROCESS:
+        snprintf(buf, size, "process %u/%llu", subject->data.p.pid,
+                (unsigned long long) subject->data.p.start_time);
+        break;
+    case SUBJECT_KIND_SYSTEM_BUS_NAME:
+        snprintf(buf, size, "bus name %s", subject->data.b.system_bus_name);
+        break;
+    case SUBJECT_KIND_UNIX_SESSION:
+        snprintf(buf, size, "session %s", subject->data.s.session_id);
+        break;
+    default:
+        snprintf(buf, size, "unknown subject");
+        break;
+    }
+}
+
+static void mismatch(struct stats *s, uint64_t seed, const char *what,
+        const struct subject *subject, const char *action_id, bool expected)
+{
+    char desc[MAX_NAME_SIZE + 32];
+
+    s->mismatches++;
+    if (s->mismatches > MAX_MISMATCHES)
+        return;
+
+    describe_subject(subject, desc, sizeof(desc));
+    fprintf(stderr, "Mismatch (seed %llu): %s of %s for %s: expected %s "
+            "(speedup %.1fx)\n", (unsigned long long) seed, what, action_id,
+            desc, expected ? "allow" : "deny", speedup(s));
+}
+
+static int run_batch(struct engine *e, struct oracle *o, struct policy *policy,
+        uint64_t seed, struct stats *s)
+{
+    static struct subject subjects[N_SUBJECTS];
+    static char queries[MAX_ACTIONS + 4][64];
+    static bool checked[N_SUBJECTS][MAX_ACTIONS + 4];
+    static uint32_t listed[N_SUBJECTS][(MAX_ACTIONS + 31) / 32 + 1];
+    uint32_t n_actions = policy_n_actions(policy);
+    uint32_t words = policy_action_words(policy);
+    enum validity validity;
+    const uint32_t *allowed;
+    int n_queries = 0;
+    uint64_t start;
+    uint32_t a;
+    bool expected;
+    int i, q, r;
+
+    for (i = 0; i < N_SUBJECTS; i++)
+        random_subject(&subjects[i]);
+
+    for (i = 0; i < o->n_lines; i++)
+        strcpy(queries[n_queries++], o->lines[i].id);
+    for (i = 0; i < 4; i++)
+        sprintf(queries[n_queries++], "org.example.a%u", rnd(2 * MAX_ACTIONS));
+
+    start = now_nsec();
+
+    for (i = 0; i < N_SUBJECTS; i++) {
+        for (q = 0; q < n_queries; q++)
+            checked[i][q] = engine_check(e, &subjects[i], queries[q], &validity);
+
+        r = engine_list(e, &subjects[i], &allowed);
+        if (r < 0) {
+            fprintf(stderr, "Listing failed: %s\n", strerror(-r));
+            return r;
+        }
+        memcpy(listed[i], allowed, words * sizeof(uint32_t));
+    }
+
+    s->engine_nsec += now_nsec() - start;
+
+    /* the reference is timed for the same work */
+
+    start = now_nsec();
+
+    for (i = 0; i < N_SUBJECTS; i++) {
+        for (q = 0; q < n_queries; q++)
+            oracle_check(o, &subjects[i], queries[q]);
+        for (a = 0; a < n_actions; a++)
+            oracle_check(o, &subjects[i], policy_action_id(policy, a));
+    }
+
+    s->oracle_nsec += now_nsec() - start;
+
+    for (i = 0; i < N_SUBJECTS; i++) {
+        for (q = 0; q < n_queries; q++) {
+            expected = oracle_check(o, &subjects[i], queries[q]);
+            if (checked[i][q] != expected)
+                mismatch(s, seed, "check", &subjects[i], queries[q], expected);
+            s->comparisons++;
+        }
+
+        for (a = 0; a < n_actions; a++) {
+            expected = oracle_check(o, &subjects[i], policy_action_id(policy, a));
+            if (!!(listed[i][a / 32] & (1U << (a % 32))) != expected)
+                mismatch(s, seed, "list", &subjects[i], policy_action_id(policy, a),
+                        expected);
+            s->comparisons++;
+        }
+    }
+
+    return 0;
+}
+
+static int run_policy(struct oracle *o, uint64_t seed, struct stats *s)
+{
+    static const size_t budgets[] = { 0, 4096, 128*1024 };
+    static char data[POLICY_SIZE];
+    struct cache_budget *budget;
+    struct policy *policy;
+    struct engine e;
+    int i, r;
+
+    random_policy(o, data);
+    random_groups(o->world);
+
+    budget = cache_budget_new(budgets[rnd(3)]);
+    if (!budget)
+        return -ENOMEM;
+
+    r = engine_init(&e, &test_provider, o->world, budget);
+    if (r < 0)
+        goto end_budget;
+
+    policy = test_load_policy(data);
+    if (!policy) {
+        fprintf(stderr, "Error loading a random policy (seed %llu):\n%s",
+                (unsigned long long) seed, data);
+        r = -EINVAL;
+        goto end;
+    }
+
+    r = engine_set_policy(&e, policy, NULL, NULL);
+    if (r < 0)
+        goto end;
+
+    /* groups resolved up front or on the first requests */
+    if (rnd(2))
+        engine_prepare(&e);
+
+    for (i = 0; i < BATCHES; i++) {
+        if (i > 0) {
+            random_groups(o->world);
+            engine_groups_changed(&e);
+        }
+
+        r = run_batch(&e, o, policy, seed, s);
+        if (r < 0)
+            goto end;
+    }
+
+end:
+    engine_done(&e);
+end_budget:
+    cache_budget_free(budget);
+
+    return r;
+}
+
+/* Rules that the generator doesn't produce: empty list entries that
+ * must load, and operators without operands that must not. */
+static int check_syntax(void)
+{
+    static const char *valid[] = {
+        "adm,", "adm,,wheel", ",adm", ",", "(adm,)&wheel", "!(adm|)",
+    };
+    static const char *invalid[] = {
+        "!", "&&,,", "adm&", "&adm", "adm,!", "()", "adm&()", "(adm&)",
+    };
+    char data[MAX_EXPR_SIZE + 32];
+    struct policy *policy;
+    int i, failures = 0;
+
+    for (i = 0; i < (int) (sizeof(valid) / sizeof(valid[0])); i++) {
+        snprintf(data, sizeof(data), "org.example.a=\"%s\"\n", valid[i]);
+        policy = test_load_policy(data);
+        if (!policy) {
+            fprintf(stderr, "Rule \"%s\" was not accepted\n", valid[i]);
+            failures++;
+        }
+        policy_free(policy);
+    }
+
+    for (i = 0; i < (int) (sizeof(invalid) / sizeof(invalid[0])); i++) {
+        snprintf(data, sizeof(data), "org.example.a=\"%s\"\n", invalid[i]);
+        policy = test_load_policy(data);
+        if (policy) {
+            fprintf(stderr, "Rule \"%s\" was accepted\n", invalid[i]);
+            failures++;
+        }
+        policy_free(policy);
+    }
+
+    return failures;
+}
+
+int main(int argc, char *argv[])
+{
+    struct test_world world;
+    struct stats s = { 0 };
+    static struct oracle o;
+    uint64_t comparisons = DEFAULT_COMPARISONS;
+    uint64_t seed = DEFAULT_SEED, policy_seed;
+    int i, n_policies = 0, r = 0;
+
+    if (argc > 1)
+        comparisons = strtoull(argv[1], NULL, 10);
+    if (argc > 2)
+        seed = strtoull(argv[2], NULL, 10);
+
+    memset(&world, 0, sizeof(struct test_world));
+
+    world.users = calloc(N_USERS, sizeof(struct test_user));
+    if (!world.users)
+        return EXIT_FAILURE;
+    world.n_users = N_USERS;
+
+    for (i = 0; i < N_USERS; i++) {
+        world.users[i].gids = calloc(BIG_USER_GIDS, sizeof(gid_t));
+        if (!world.users[i].gids)
+            return EXIT_FAILURE;
+    }
+
+    o.world = &world;
+
+    if (check_syntax() > 0)
+        return EXIT_FAILURE;
+
+    /* Each policy gets a seed of its own, so that a mismatch can be
+     * reproduced by running with that seed and one policy's worth of
+     * comparisons. The users stay the same for a policy, because the
+     * engine may legitimately keep their credentials cached. */
+
+    policy_seed = seed;
+
+    while (s.comparisons < comparisons) {
+        rng_state = policy_seed * 0x9e3779b97f4a7c15ULL + 1;
+
+        random_users(&world);
+
+        r = run_policy(&o, policy_seed, &s);
+        if (r < 0)
+            break;
+
+        n_policies++;
+        policy_seed++;
+    }
+
+    for (i = 0; i < N_USERS; i++)
+        free(world.users[i].gids);
+    free(world.users);
+
+    if (r < 0)
+        return EXIT_FAILURE;
+
+    fprintf(stdout, "%llu comparisons with %d policies, %llu mismatches, "
+            "engine %.1f ms, reference %.1f ms, speedup %.1fx\n",
+            (unsigned long long) s.comparisons, n_policies,
+            (unsigned long long) s.mismatches, s.engine_nsec / 1e6,
+            s.oracle_nsec / 1e6, speedup(&s));
+
+    return s.mismatches > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
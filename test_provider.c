@@ -0,0 +1,177 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "test_provider.h"
+
+static int user_creds(struct test_world *w, uid_t uid, struct engine_creds *creds)
+{
+    struct test_user *u;
+    int i;
+
+    if (uid >= (uid_t) w->n_users)
+        return -ESRCH;
+
+    u = &w->users[uid];
+
+    creds->uid = uid;
+    creds->primary_gid = u->primary_gid;
+    creds->n_gids = u->n_gids;
+    for (i = 0; i < u->n_gids && i < creds->max_gids; i++)
+        creds->gids[i] = u->gids[i];
+
+    return 0;
+}
+
+static int test_process_creds(void *userdata, uint32_t pid, uint64_t start_time,
+        struct engine_creds *creds)
+{
+    struct test_world *w = userdata;
+
+    w->queries++;
+
+    if (start_time != pid * 10ULL)
+        return -EINVAL;
+
+    return user_creds(w, pid, creds);
+}
+
+static int test_process_start_time(void *userdata, uint32_t pid,
+        uint64_t *start_time)
+{
+    struct test_world *w = userdata;
+
+    w->queries++;
+
+    if (pid >= (uint32_t) w->n_users)
+        return -ESRCH;
+
+    *start_time = pid * 10ULL;
+    return 0;
+}
+
+static int test_bus_name_creds(void *userdata, const char *name,
+        struct engine_creds *creds)
+{
+    struct test_world *w = userdata;
+    unsigned int uid;
+
+    w->queries++;
+
+    if (sscanf(name, ":1.%u", &uid) != 1)
+        return -ENXIO;
+
+    return user_creds(w, uid, creds);
+}
+
+static int test_session_uid(void *userdata, const char *session_id, uid_t *uid)
+{
+    struct test_world *w = userdata;
+    unsigned int n;
+
+    w->queries++;
+
+    if (sscanf(session_id, "c%u", &n) != 1)
+        return -ENXIO;
+
+    *uid = n;
+    return 0;
+}
+
+static int test_user_groups(void *userdata, uid_t uid, struct engine_creds *creds)
+{
+    struct test_world *w = userdata;
+
+    w->queries++;
+
+    return user_creds(w, uid, creds);
+}
+
+static int test_group_gid(void *userdata, const char *name, gid_t *gid)
+{
+    struct test_world *w = userdata;
+    int i;
+
+    w->queries++;
+
+    for (i = 0; i < w->n_groups; i++) {
+        if (strcmp(w->group_names[i], name) == 0) {
+            *gid = w->group_gids[i];
+            return 0;
+        }
+    }
+
+    return -ENOENT;
+}
+
+const struct engine_provider test_provider = {
+    .process_creds = test_process_creds,
+    .process_start_time = test_process_start_time,
+    .bus_name_creds = test_bus_name_creds,
+    .session_uid = test_session_uid,
+    .user_groups = test_user_groups,
+    .group_gid = test_group_gid,
+};
+
+void test_make_subject(enum subject_kind kind, uint32_t uid, struct subject *subject)
+{
+    memset(subject, 0, sizeof(struct subject));
+
+    subject->kind = kind;
+
+    switch (kind) {
+    case SUBJECT_KIND_UNIX_PROCESS:
+        subject->data.p.pid = uid;
+        subject->data.p.start_time = uid * 10ULL;
+        break;
+    case SUBJECT_KIND_SYSTEM_BUS_NAME:
+        snprintf(subject->data.b.system_bus_name, MAX_NAME_SIZE, ":1.%u", uid);
+        break;
+    case SUBJECT_KIND_UNIX_SESSION:
+        snprintf(subject->data.s.session_id, MAX_NAME_SIZE, "c%u", uid);
+        break;
+    default:
+        break;
+    }
+}
+
+struct policy *test_load_policy(const char *data)
+{
+    char path[] = "/tmp/groupcheck-test.XXXXXX";
+    struct policy *policy;
+    size_t len = strlen(data);
+    int fd;
+
+    fd = mkstemp(path);
+    if (fd < 0)
+        return NULL;
+
+    if (write(fd, data, len) != (ssize_t) len) {
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+
+    close(fd);
+    policy = policy_load(path);
+    unlink(path);
+
+    return policy;
+}
@@ -0,0 +1,58 @@
+/*
+ * groupcheck is a minimal polkit replacement for group-based authentication.
+ * Copyright (c) 2016, Intel Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU Lesser General Public License,
+ * version 2.1, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+ * more details.
+ */
+
+
+#ifndef GROUPCHECK_TEST_PROVIDER_H
+#define GROUPCHECK_TEST_PROVIDER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "engine.h"
+#include "policy.h"
+
+/* A made-up system for the tests: groups, and users that are known by
+ * their uid. Process pid N belongs to user N and has start time N * 10, bus
+ * name ":1.N" and session "cN" too. */
+
+#define TEST_MAX_GROUPS 256
+#define TEST_GROUP_NAME_SIZE 32
+
+struct test_user {
+    gid_t primary_gid;
+    int n_gids;
+    gid_t *gids;
+};
+
+struct test_world {
+    int n_groups;
+    char group_names[TEST_MAX_GROUPS][TEST_GROUP_NAME_SIZE];
+    gid_t group_gids[TEST_MAX_GROUPS];
+
+    int n_users;
+    struct test_user *users;
+
+    /* number of provider calls */
+    uint64_t queries;
+};
+
+/* the userdata is a struct test_world */
+extern const struct engine_provider test_provider;
+
+void test_make_subject(enum subject_kind kind, uint32_t uid, struct subject *subject);
+
+/* compile policy file contents */
+struct policy *test_load_policy(const char *data);
+
+#endif /* GROUPCHECK_TEST_PROVIDER_H */